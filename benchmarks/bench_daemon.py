@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Benchmarks for the pulsar_domed hot paths.
+Runs against simulated serial ports, so no hardware is needed, and optionally
+compares the results against a baseline recorded on the observatory machine.
+"""
+
+import argparse
+import importlib.machinery
+import importlib.util
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+REPO_PATH = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Benchmark the working tree rather than any installed copy of the package
+sys.path.insert(0, REPO_PATH)
+
+# pylint: disable=wrong-import-position
+import numpy as np
+import serial
+from rockit.dome.pulsar import Config
+from rockit.dome.pulsar.astrometry import AstrometryWorker, Trajectory, TRAJECTORY_STEP, TRAJECTORY_DURATION
+from rockit.dome.pulsar.simulator import SimulatedAzimuthDrive, SimulatedAzimuthPort, SimulatedShutterPort
+from rockit.dome.pulsar.tracking import offset_azimuth
+# pylint: enable=wrong-import-position
+
+# Default allowed slowdown relative to the baseline, as a fraction of the baseline time
+DEFAULT_THRESHOLD = 0.5
+
+# Number of times each case is repeated. Comparisons use the fastest repeat,
+# which is the least affected by other activity on the machine
+REPEATS = 11
+
+# Maximum time to wait for the daemon to connect to the simulated ports
+CONNECT_TIMEOUT = 10
+
+# Number of short slews timed by the azimuth_wait case, and the maximum time allowed for each
+WAIT_SLEWS = 6
+WAIT_TIMEOUT = 30
+
+# Cases that need a DomeDaemon connected to the simulated ports
+DAEMON_CASES = ['status', 'azimuth_wait']
+
+# Cases that are reported against the baseline but never fail the comparison.
+# azimuth_wait measures latency across daemon threads, which depends on scheduling more than on the code
+INFORMATIONAL_CASES = ['azimuth_wait']
+
+
+def load_daemon_module():
+    """Imports the pulsar_domed script as a module"""
+    loader = importlib.machinery.SourceFileLoader('pulsar_domed', os.path.join(REPO_PATH, 'pulsar_domed'))
+    spec = importlib.util.spec_from_loader('pulsar_domed', loader)
+    module = importlib.util.module_from_spec(spec)
+    loader.exec_module(module)
+    return module
+
+
+def measure(func, iterations, repeats=REPEATS):
+    """Times iterations calls of func, repeats times. Returns the result dictionary in microseconds per call"""
+    times = []
+    for _ in range(repeats):
+        start = time.perf_counter()
+        for _ in range(iterations):
+            func()
+        times.append(1e6 * (time.perf_counter() - start) / iterations)
+
+    return {
+        'median_us': statistics.median(times),
+        'min_us': min(times),
+        'max_us': max(times),
+        'iterations': iterations,
+        'repeats': repeats
+    }
+
+
+def bench_azimuth_status_parse(context):
+    """Decoding of the azimuth controller response to the V status command"""
+    parse = context['daemon_module'].parse_azimuth_status
+    response = b'140.3\t1\t0\t180.0\t0\t0\t0\t0\t0\t0\t0\t0\t0\r'
+    return measure(lambda: parse(response), 20000)
+
+
+def bench_shutter_frame_decode(context):
+    """Matching and decoding of a shutter controller status line"""
+    module = context['daemon_module']
+    regex = re.compile(module.SHUTTER_REGEX)
+    data = b'02,042,0612,0598\r\n'
+
+    def decode():
+        match = regex.match(data.decode('ascii'))
+        return module.parse_shutter_status(match)
+
+    return measure(decode, 20000)
+
+
+def bench_offset_azimuth(context):
+    """Conversion of a telescope alt/az to the dome azimuth"""
+    config = context['config']
+    return measure(lambda: offset_azimuth(config, 45.0, 123.0), 20000)
+
+
+def bench_trajectory_interpolate(_):
+    """Interpolation of the dome azimuth from a tracked trajectory"""
+    start = time.time()
+    times = start + np.arange(0, TRAJECTORY_DURATION + TRAJECTORY_STEP, TRAJECTORY_STEP)
+    azimuth = (times - start) * 0.004 % 360
+    samples = (azimuth, azimuth, np.full_like(times, 20), np.full_like(times, 45), azimuth)
+    trajectory = Trajectory('radec', (10, 20), times, samples)
+    return measure(lambda: trajectory.dome_azimuth(start + 1234.5), 20000)
+
+
+def bench_trajectory_evaluate(context):
+    """Round trip through the astrometry worker for a one hour trajectory"""
+    worker = AstrometryWorker(context['config'])
+
+    # The first request includes the worker startup and astropy import
+    worker.request('radec', (10, 20), time.time()).wait()
+    return measure(lambda: worker.request('radec', (10, 20), time.time()).wait(), 5, repeats=3)
+
+
+def bench_status(context):
+    """Building the status() response"""
+    daemon = context['daemon']
+    return measure(daemon.status, 2000)
+
+
+def bench_azimuth_wait(context):
+    """Delay from the simulated drive reporting that a slew has stopped until wait_until_azimuth_idle returns"""
+    daemon = context['daemon']
+    port = context['azimuth_port']
+    config = context['config']
+    module = context['daemon_module']
+
+    # Requests are queued directly to skip the Pyro client and follow mode checks
+    # pylint: disable=protected-access
+    if daemon.status()['azimuth_status'] == module.AzimuthStatus.NotHomed:
+        daemon._azimuth_request('home_azimuth')
+        daemon.wait_until_azimuth_idle(WAIT_TIMEOUT)
+
+    # Speed up the drive so that each slew takes around a second
+    drive = port.drive
+    speed, acceleration, creep_speed = drive.speed, drive.acceleration, drive.creep_speed
+    drive.speed, drive.acceleration, drive.creep_speed = 20, 40, 5
+
+    latencies = []
+    try:
+        for i in range(WAIT_SLEWS):
+            daemon._azimuth_request('slew_azimuth', config.park_azimuth + (10 if i % 2 == 0 else 0))
+            if not daemon.wait_until_azimuth_idle(WAIT_TIMEOUT):
+                raise TimeoutError('simulated slew did not complete')
+            latencies.append(1e6 * (time.monotonic() - port.stop_reported))
+    finally:
+        drive.speed, drive.acceleration, drive.creep_speed = speed, acceleration, creep_speed
+    # pylint: enable=protected-access
+
+    return {
+        'median_us': statistics.median(latencies),
+        'min_us': min(latencies),
+        'max_us': max(latencies),
+        'iterations': 1,
+        'repeats': WAIT_SLEWS
+    }
+
+
+def bench_config_load(context):
+    """Loading and validating the daemon config file"""
+    path = context['config_path']
+    return measure(lambda: Config(path), 200)
+
+
+def bench_dome_cli_start(_):
+    """Start-up time of the dome command line client (printing usage)"""
+    def run():
+        subprocess.run([sys.executable, os.path.join(REPO_PATH, 'dome')], check=False,
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    return measure(run, 1, repeats=5)
+
+
+CASES = {
+    'azimuth_status_parse': bench_azimuth_status_parse,
+    'shutter_frame_decode': bench_shutter_frame_decode,
+    'offset_azimuth': bench_offset_azimuth,
+    'trajectory_interpolate': bench_trajectory_interpolate,
+    'trajectory_evaluate': bench_trajectory_evaluate,
+    'status': bench_status,
+    'azimuth_wait': bench_azimuth_wait,
+    'config_load': bench_config_load,
+    'dome_cli_start': bench_dome_cli_start,
+}
+
+
+def start_daemon(module, config):
+    """
+    Creates a DomeDaemon connected to simulated azimuth and shutter controllers.
+    Returns the daemon and the simulated azimuth port.
+    """
+    azimuth_port = SimulatedAzimuthPort(SimulatedAzimuthDrive(config.park_azimuth, 4, 1))
+    shutter_port = SimulatedShutterPort()
+
+    def simulated_port(port, *_, **__):
+        return azimuth_port if port == config.azimuth_serial_port else shutter_port
+
+    serial.Serial = simulated_port
+    daemon = module.DomeDaemon(config)
+
+    start = time.monotonic()
+    while time.monotonic() - start < CONNECT_TIMEOUT:
+        status = daemon.status()
+        if status['azimuth_status'] != module.AzimuthStatus.Disconnected and \
+                status['shutter'] != module.ShutterStatus.Disconnected:
+            return daemon, azimuth_port
+        time.sleep(0.1)
+
+    raise TimeoutError('daemon failed to connect to the simulated ports')
+
+
+def compare(results, baseline, threshold):
+    """Prints the change relative to baseline and returns the names of the cases that regressed"""
+    thresholds = baseline.get('thresholds', {})
+    regressions = []
+    for name, result in results['cases'].items():
+        reference = baseline['cases'].get(name)
+        if reference is None:
+            print(f'{name:>24}: {result["min_us"]:12.2f} us (not in baseline)')
+            continue
+
+        change = result['min_us'] / reference['min_us'] - 1
+        if name in INFORMATIONAL_CASES:
+            print(f'{name:>24}: {result["min_us"]:12.2f} us ({change * 100:+6.1f}% vs baseline, not checked)')
+            continue
+
+        limit = thresholds.get(name, threshold)
+        regressed = change > limit
+        if regressed:
+            regressions.append(name)
+
+        label = 'REGRESSION' if regressed else 'ok'
+        print(f'{name:>24}: {result["min_us"]:12.2f} us ({change * 100:+6.1f}% vs baseline, '
+              f'limit {limit * 100:+.0f}%) {label}')
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmarks the pulsar_domed hot paths against simulated hardware')
+    parser.add_argument('--config', default=os.path.join(REPO_PATH, 'warwick.json'),
+                        help='Path to the daemon configuration json file')
+    parser.add_argument('--output', help='Path to save the results json')
+    parser.add_argument('--baseline', help='Path to a previous results json to compare against')
+    parser.add_argument('--allow-missing-baseline', action='store_true',
+                        help='Only warn (rather than fail) if the --baseline file does not exist')
+    parser.add_argument('--threshold', type=float, default=DEFAULT_THRESHOLD,
+                        help='Allowed fractional slowdown relative to the baseline '
+                             '(overridden per case by the baseline "thresholds" dictionary)')
+    parser.add_argument('--cases', help='Comma-separated list of cases to run (default all)')
+    args = parser.parse_args()
+
+    names = list(CASES) if args.cases is None else args.cases.split(',')
+    unknown = [name for name in names if name not in CASES]
+    if unknown:
+        print('error: unknown cases ' + ', '.join(unknown))
+        return 1
+
+    module = load_daemon_module()
+    config = Config(args.config)
+    context = {
+        'config_path': args.config,
+        'config': config,
+        'daemon_module': module,
+    }
+
+    if any(name in DAEMON_CASES for name in names):
+        context['daemon'], context['azimuth_port'] = start_daemon(module, config)
+
+    results = {
+        'created': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+        'host': platform.node(),
+        'python': platform.python_version(),
+        'cases': {}
+    }
+
+    for name in names:
+        results['cases'][name] = CASES[name](context)
+        if args.baseline is None:
+            print(f'{name:>24}: {results["cases"][name]["min_us"]:12.2f} us')
+
+    if args.output is not None:
+        with open(args.output, 'w', encoding='utf-8') as output_file:
+            json.dump(results, output_file, indent=2)
+            output_file.write('\n')
+
+    if args.baseline is not None:
+        if not os.path.exists(args.baseline):
+            prefix = 'warning' if args.allow_missing_baseline else 'error'
+            print(f'{prefix}: baseline {args.baseline} does not exist; run `make bench-baseline` to record one')
+            for name, result in results['cases'].items():
+                print(f'{name:>24}: {result["min_us"]:12.2f} us')
+            return 0 if args.allow_missing_baseline else 1
+
+        with open(args.baseline, 'r', encoding='utf-8') as baseline_file:
+            baseline = json.load(baseline_file)
+
+        # Timings from another machine are not comparable, so only report the differences
+        same_host = baseline.get('host') == results['host']
+        if not same_host:
+            print(f'warning: baseline was recorded on {baseline.get("host")}, not {results["host"]}; '
+                  'regressions will not fail the comparison')
+
+        regressions = compare(results, baseline, args.threshold)
+        if regressions and not same_host:
+            print('warning: performance regressions in ' + ', '.join(regressions))
+        elif regressions:
+            print('error: performance regressions in ' + ', '.join(regressions))
+            return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,159 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Online estimation of azimuth drive performance from the status polls made during slews"""
+
+import collections
+import numpy as np
+from .tracking import azimuth_delta, TARGET_TOLERANCE
+
+# Number of recent slews used for the rolling baselines
+BASELINE_HISTORY = 50
+
+# Minimum number of slews in the baseline before slow slews are flagged
+MIN_BASELINE_SLEWS = 5
+
+# Slews shorter than this (in degrees) don't reach full speed, so are excluded from the baselines
+MIN_BASELINE_DISTANCE = 10
+
+# The settle time is measured from when the dome comes within this many degrees of the target
+# until the slew finishes, i.e. until the daemon reports the dome as idle after any settle dwell and nudges
+SETTLE_DISTANCE = 3
+
+# A moving dome that advances less than STALL_DISTANCE degrees in STALL_SECONDS has stalled
+STALL_DISTANCE = 0.1
+STALL_SECONDS = 1
+
+SlewRecord = collections.namedtuple('SlewRecord', [
+    'distance', 'duration', 'peak_speed', 'acceleration', 'settle_time', 'stalled', 'slow'
+])
+
+
+class SlewAnalytics:
+    """
+    Estimates the peak speed, acceleration and settle time of each slew from
+    the sampled dome position, and flags slews that are slower than a rolling
+    baseline by more than warning_margin (a fraction of the baseline value)
+    """
+    def __init__(self, warning_margin):
+        self._warning_margin = warning_margin
+
+        # (monotonic time, unwrapped azimuth) samples for the active slew
+        self._samples = None
+        self._target = None
+        self._stalled = False
+
+        self._peak_speed_history = collections.deque(maxlen=BASELINE_HISTORY)
+        self._acceleration_history = collections.deque(maxlen=BASELINE_HISTORY)
+
+        self.last = None
+        self.slews = 0
+        self.stalls = 0
+        self.slow_slews = 0
+
+    def update(self, timestamp, azimuth, target_azimuth, moving):
+        """
+        Adds a status poll. moving is True while the daemon reports the dome as slewing (but not homing),
+        so the slew finishes when the daemon reports it as idle rather than when the motor first stops.
+        Returns a SlewRecord when a slew finishes, otherwise None.
+        """
+        if self._samples is None:
+            if moving:
+                self._samples = [(timestamp, azimuth)]
+                self._target = target_azimuth
+                self._stalled = False
+            return None
+
+        # Unwrap relative to the previous sample so that slews through north are continuous
+        previous = self._samples[-1][1]
+        self._samples.append((timestamp, previous + azimuth_delta(azimuth, previous % 360)))
+        self._target = target_azimuth
+
+        if moving:
+            self.__check_stall(timestamp, azimuth)
+            return None
+
+        # Stopping short of the target also counts as a stall
+        if abs(azimuth_delta(self._target, azimuth)) > TARGET_TOLERANCE:
+            self._stalled = True
+
+        record = self.__finish_slew()
+        self._samples = None
+        return record
+
+    def __check_stall(self, timestamp, azimuth):
+        if self._stalled or abs(azimuth_delta(self._target, azimuth)) <= TARGET_TOLERANCE:
+            return
+
+        for sample_time, sample_azimuth in reversed(self._samples):
+            if timestamp - sample_time >= STALL_SECONDS:
+                self._stalled = abs(self._samples[-1][1] - sample_azimuth) < STALL_DISTANCE
+                break
+
+    def __finish_slew(self):
+        times, positions = np.array(self._samples).T
+        distance = abs(positions[-1] - positions[0])
+        duration = times[-1] - times[0]
+
+        peak_speed = acceleration = 0
+        intervals = np.diff(times)
+        valid = intervals > 0
+        if np.any(valid):
+            speeds = np.abs(np.diff(positions)[valid] / intervals[valid])
+            midpoints = (times[:-1][valid] + times[1:][valid]) / 2
+            peak_speed = float(np.max(speeds))
+
+            # Estimate acceleration from the time taken to reach 90% of the peak speed
+            if peak_speed > 0:
+                ramp_time = midpoints[np.argmax(speeds >= 0.9 * peak_speed)] - times[0]
+                if ramp_time > 0:
+                    acceleration = float(0.9 * peak_speed / ramp_time)
+
+        target = positions[0] + azimuth_delta(self._target, positions[0] % 360)
+        near = np.abs(positions - target) <= SETTLE_DISTANCE
+        settle_time = float(times[-1] - times[np.argmax(near)]) if np.any(near) else 0
+
+        slow = False
+        if distance >= MIN_BASELINE_DISTANCE:
+            if len(self._peak_speed_history) >= MIN_BASELINE_SLEWS:
+                baseline_speed, baseline_acceleration = self.baseline()
+
+                # Shorter slews start decelerating before they reach full speed
+                expected_speed = min(baseline_speed, np.sqrt(baseline_acceleration * distance))
+                threshold = 1 - self._warning_margin
+                slow = bool(peak_speed < threshold * expected_speed or
+                            acceleration < threshold * baseline_acceleration)
+
+            # Flagged slews are left out so that a degrading drive doesn't drag the baseline down with it
+            if not slow and not self._stalled:
+                self._peak_speed_history.append(peak_speed)
+                self._acceleration_history.append(acceleration)
+
+        self.slews += 1
+        if self._stalled:
+            self.stalls += 1
+        if slow:
+            self.slow_slews += 1
+
+        self.last = SlewRecord(float(distance), float(duration), peak_speed, acceleration,
+                               settle_time, self._stalled, slow)
+        return self.last
+
+    def baseline(self):
+        """Returns the rolling median (peak speed, acceleration), or (None, None) if there are no long slews"""
+        if not self._peak_speed_history:
+            return None, None
+        return float(np.median(self._peak_speed_history)), float(np.median(self._acceleration_history))
@@ -0,0 +1,229 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Astrometry worker process that evaluates dome azimuth trajectories.
+Keeps astropy out of the daemon process so that slow transforms
+or IERS updates cannot stall the serial I/O threads.
+"""
+
+import itertools
+import multiprocessing
+import threading
+import types
+import numpy as np
+from .realtime import reset_thread_scheduling, thread_affinity
+from .tracking import offset_azimuth
+
+# Spacing between trajectory samples, in seconds
+TRAJECTORY_STEP = 30
+
+# Length of the trajectory requested for a tracked target, in seconds
+TRAJECTORY_DURATION = 3600
+
+
+class Trajectory:
+    """Dome azimuth and telescope coordinates for a target, linearly interpolated between samples"""
+    # Trajectories are followed by AzimuthController (unlike FixedTargets)
+    tracking = True
+
+    def __init__(self, kind, args, times, samples):
+        self.kind = kind
+        self.args = args
+        self._times = times
+
+        # Dome azimuth and telescope ra, dec, altitude, azimuth at each time
+        dome_azimuth, ra, dec, altitude, azimuth = samples
+
+        # Unwrap angles so that interpolation doesn't pass the long way round through 180 deg
+        self._dome_azimuth = np.degrees(np.unwrap(np.radians(dome_azimuth)))
+        self._ra = np.degrees(np.unwrap(np.radians(ra)))
+        self._dec = dec
+        self._altitude = altitude
+        self._azimuth = np.degrees(np.unwrap(np.radians(azimuth)))
+
+    @property
+    def end(self):
+        """Unix time of the last sample"""
+        return self._times[-1]
+
+    def dome_azimuth(self, unix_time):
+        """Returns the dome azimuth required at the given unix time"""
+        return float(np.interp(unix_time, self._times, self._dome_azimuth) % 360)
+
+    def dome_azimuths(self, unix_times):
+        """Returns the dome azimuth required at each of an array of unix times"""
+        return np.interp(unix_times, self._times, self._dome_azimuth) % 360
+
+    def altitude(self, unix_time):
+        """Returns the telescope altitude at the given unix time"""
+        return float(np.interp(unix_time, self._times, self._altitude))
+
+    def coordinates(self, unix_time):
+        """Returns the telescope (ra, dec, azimuth) in degrees at the given unix time"""
+        return (float(np.interp(unix_time, self._times, self._ra) % 360),
+                float(np.interp(unix_time, self._times, self._dec)),
+                float(np.interp(unix_time, self._times, self._azimuth) % 360))
+
+
+class TrajectoryRequest:
+    """Completion tracking for a trajectory requested from the worker"""
+    def __init__(self, kind, args, times):
+        self.kind = kind
+        self.args = args
+        self.times = times
+        self.trajectory = None
+        self._complete = threading.Event()
+
+    def complete(self, trajectory):
+        """Mark the request as finished. trajectory is None if the evaluation failed"""
+        self.trajectory = trajectory
+        self._complete.set()
+
+    def done(self):
+        """Returns True if the worker has responded (or failed)"""
+        return self._complete.is_set()
+
+    def wait(self, timeout=None):
+        """Block until the trajectory is available. Returns the Trajectory, or None on failure or timeout"""
+        self._complete.wait(timeout)
+        return self.trajectory
+
+
+class AstrometryWorker:
+    """Owns the astrometry worker process and matches its responses to outstanding requests"""
+    def __init__(self, config, log_error=None):
+        # Only pass the (picklable) values that the worker needs.
+        # A restart may be triggered from a real-time I/O thread, so the worker and receiver
+        # thread return to the normal scheduling and CPU affinity of the thread creating this object
+        self._params = types.SimpleNamespace(
+            latitude=config.latitude,
+            longitude=config.longitude,
+            altitude=config.altitude,
+            dome_radius_cm=config.dome_radius_cm,
+            telescope_offset_x_cm=config.telescope_offset_x_cm,
+            affinity=thread_affinity())
+
+        self._log_error = log_error
+        self._context = multiprocessing.get_context('spawn')
+        self._lock = threading.Lock()
+        self._ids = itertools.count()
+        self._process = None
+        self._connection = None
+        self._pending = None
+        self.__start()
+
+    def __start(self):
+        connection, worker_connection = self._context.Pipe()
+        self._process = self._context.Process(target=_worker_main, args=(worker_connection, self._params),
+                                              name='astrometry', daemon=True)
+        self._process.start()
+        worker_connection.close()
+
+        # Each worker instance has its own set of pending requests, so that
+        # a restart can't complete requests belonging to the new worker
+        self._connection = connection
+        self._pending = {}
+        threading.Thread(target=self.__receive_thread, args=(connection, self._pending),
+                         name='astrometry-receiver', daemon=True).start()
+
+    def request(self, kind, args, start, duration=TRAJECTORY_DURATION):
+        """
+        Asynchronously evaluate the trajectory of a 'radec' (ra, dec) or 'body' (name,)
+        target, sampled from the unix time start for the given number of seconds.
+        Returns a TrajectoryRequest that can be used to wait for the result.
+        """
+        times = start + np.arange(0, duration + TRAJECTORY_STEP, TRAJECTORY_STEP)
+        request = TrajectoryRequest(kind, args, times)
+        with self._lock:
+            if not self._process.is_alive():
+                if self._log_error is not None:
+                    self._log_error('Restarting astrometry worker')
+                self.__start()
+
+            request_id = next(self._ids)
+            self._pending[request_id] = request
+            try:
+                self._connection.send((request_id, kind, args, times))
+            except (OSError, ValueError):
+                self._pending.pop(request_id)
+                request.complete(None)
+
+        return request
+
+    def __receive_thread(self, connection, pending):
+        reset_thread_scheduling(self._params.affinity)
+        while True:
+            try:
+                request_id, result, error = connection.recv()
+            except (EOFError, OSError):
+                break
+
+            with self._lock:
+                request = pending.pop(request_id, None)
+
+            if request is None:
+                continue
+
+            if error is not None:
+                if self._log_error is not None:
+                    self._log_error('Failed to evaluate trajectory (' + error + ')')
+                request.complete(None)
+            else:
+                request.complete(Trajectory(request.kind, request.args, request.times, result))
+
+        with self._lock:
+            for request in pending.values():
+                request.complete(None)
+            pending.clear()
+
+
+def _worker_main(connection, params):
+    """Entry point of the worker process"""
+    reset_thread_scheduling(params.affinity)
+
+    # Imported here so that the daemon process never loads astropy
+    # pylint: disable=import-outside-toplevel
+    from astropy.coordinates import AltAz, EarthLocation, get_body, SkyCoord
+    from astropy.time import Time
+    import astropy.units as u
+
+    location = EarthLocation(
+        lat=params.latitude*u.deg,
+        lon=params.longitude*u.deg,
+        height=params.altitude*u.m)
+
+    while True:
+        try:
+            request_id, kind, args, times = connection.recv()
+        except EOFError:
+            return
+
+        try:
+            obstime = Time(times, format='unix')
+            if kind == 'body':
+                coord = get_body(args[0], obstime)
+            else:
+                coord = SkyCoord(ra=args[0], dec=args[1], unit=u.deg, frame='icrs')
+
+            altaz = coord.transform_to(AltAz(obstime=obstime, location=location))
+            alt = altaz.alt.to_value(u.deg)
+            az = altaz.az.to_value(u.deg)
+            icrs = altaz.icrs
+            result = (offset_azimuth(params, alt, az), icrs.ra.to_value(u.deg), icrs.dec.to_value(u.deg), alt, az)
+            connection.send((request_id, result, None))
+        except Exception as exception:
+            connection.send((request_id, None, str(exception)))
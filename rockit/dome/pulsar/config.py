@@ -132,6 +132,49 @@ CONFIG_SCHEMA = {
         'tracking_max_separation': {
             'type': 'number',
             'minimum': 0
+        },
+        'target_log_path': {
+            'type': 'string'
+        },
+        'preslew_lead_time': {
+            'type': 'number',
+            'minimum': 0
+        },
+        'exposure_max_separation': {
+            'type': 'number',
+            'minimum': 0
+        },
+        'exposure_premove_time': {
+            'type': 'number',
+            'minimum': 0
+        },
+        'trace_path': {
+            'type': 'string'
+        },
+        'final_approach_tolerance': {
+            'type': 'number',
+            'minimum': 0.1
+        },
+        'slew_warning_margin': {
+            'type': 'number',
+            'minimum': 0,
+            'maximum': 1
+        },
+        'io_thread_policy': {
+            'type': 'string',
+            'enum': ['fifo', 'rr']
+        },
+        'io_thread_priority': {
+            'type': 'integer',
+            'minimum': 1,
+            'maximum': 99
+        },
+        'io_thread_cpus': {
+            'type': 'array',
+            'items': {
+                'type': 'integer',
+                'minimum': 0
+            }
         }
     }
 }
@@ -171,3 +214,13 @@ class Config:
         self.dome_radius_cm = config_json['dome_radius_cm']
         self.telescope_offset_x_cm = config_json['telescope_offset_x_cm']
         self.tracking_max_separation = config_json['tracking_max_separation']
+        self.target_log_path = config_json.get('target_log_path', None)
+        self.preslew_lead_time = config_json.get('preslew_lead_time', 0)
+        self.exposure_max_separation = config_json.get('exposure_max_separation', 0)
+        self.exposure_premove_time = config_json.get('exposure_premove_time', 0)
+        self.trace_path = config_json.get('trace_path', None)
+        self.final_approach_tolerance = config_json.get('final_approach_tolerance', None)
+        self.slew_warning_margin = config_json.get('slew_warning_margin', 0.2)
+        self.io_thread_policy = config_json.get('io_thread_policy', None)
+        self.io_thread_priority = config_json.get('io_thread_priority', 10)
+        self.io_thread_cpus = config_json.get('io_thread_cpus', None)
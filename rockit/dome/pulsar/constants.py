@@ -33,6 +33,7 @@ class CommandStatus:
     HeartbeatCloseInProgress = 14
     HeartbeatInvalidTimeout = 16
     FollowModeActive = 19
+    BatchInvalid = 20
 
     _messages = {
         # General error codes
@@ -49,6 +50,7 @@ class CommandStatus:
         16: 'error: heartbeat timeout must be less than 120s',
         17: 'error: heartbeat must be disabled before enabling engineering mode',
         18: 'error: dome is in engineering mode',
+        20: 'error: batch contains invalid operations',
 
         -100: 'error: terminated by user',
         -101: 'error: unable to communicate with dome daemon'
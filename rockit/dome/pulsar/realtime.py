@@ -0,0 +1,110 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Scheduling policy and loop jitter measurement for the serial I/O threads"""
+
+import collections
+import os
+import threading
+import numpy as np
+
+# Number of recent loop periods used for the jitter statistics
+JITTER_HISTORY = 1000
+
+
+def configure_io_thread(config, log_error=None):
+    """
+    Applies the configured scheduling policy and CPU affinity to the calling thread.
+    Settings that are not supported or permitted are logged and otherwise ignored.
+    """
+    def report(message):
+        if log_error is not None:
+            log_error(message)
+
+    name = threading.current_thread().name
+    if config.io_thread_policy is not None:
+        try:
+            # Linux applies the policy of pid 0 to the calling thread only
+            policy = getattr(os, 'SCHED_' + config.io_thread_policy.upper())
+            os.sched_setscheduler(0, policy, os.sched_param(config.io_thread_priority))
+        except (AttributeError, OSError) as exception:
+            report(f'Failed to set {config.io_thread_policy} scheduling for {name} thread ({exception})')
+
+    if config.io_thread_cpus is not None:
+        try:
+            os.sched_setaffinity(0, config.io_thread_cpus)
+        except (AttributeError, OSError) as exception:
+            report(f'Failed to set CPU affinity for {name} thread ({exception})')
+
+
+def thread_affinity():
+    """Returns the CPU affinity of the calling thread, or None if it is not supported"""
+    try:
+        return os.sched_getaffinity(0)
+    except (AttributeError, OSError):
+        return None
+
+
+def reset_thread_scheduling(affinity):
+    """
+    Restores normal scheduling and the given CPU affinity (from thread_affinity) for the calling thread.
+    Threads and processes inherit the policy of the thread that starts them, so this undoes
+    configure_io_thread for work that may be started from an I/O thread.
+    """
+    try:
+        os.sched_setscheduler(0, os.SCHED_OTHER, os.sched_param(0))
+    except (AttributeError, OSError):
+        pass
+
+    if affinity is not None:
+        try:
+            os.sched_setaffinity(0, affinity)
+        except (AttributeError, OSError):
+            pass
+
+
+class JitterMonitor:
+    """Records how far the measured period of a loop deviates from its nominal period"""
+    def __init__(self, nominal):
+        self._nominal = nominal
+        self._lock = threading.Lock()
+        self._jitter = collections.deque(maxlen=JITTER_HISTORY)
+
+    def record(self, jitter):
+        """Adds a measured start-to-start loop interval minus the nominal period, in seconds"""
+        with self._lock:
+            self._jitter.append(jitter)
+
+    def report(self):
+        """Returns the jitter distribution (in ms) of the most recent loops"""
+        with self._lock:
+            jitter = 1000 * np.array(self._jitter)
+
+        data = {
+            'nominal_ms': 1000 * self._nominal,
+            'samples': len(jitter)
+        }
+
+        if len(jitter) > 0:
+            data.update({
+                'min_ms': float(np.min(jitter)),
+                'mean_ms': float(np.mean(jitter)),
+                'p50_ms': float(np.percentile(jitter, 50)),
+                'p99_ms': float(np.percentile(jitter, 99)),
+                'max_ms': float(np.max(jitter))
+            })
+
+        return data
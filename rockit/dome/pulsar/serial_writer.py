@@ -0,0 +1,150 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Single-writer priority queue for serial ports shared between threads"""
+
+import itertools
+import queue
+import threading
+import time
+
+
+class WritePriority:
+    """Write priority classes, in the order that they are sent"""
+    Safety, Motion, Heartbeat = range(3)
+
+    _labels = {
+        0: 'safety',
+        1: 'motion',
+        2: 'heartbeat'
+    }
+
+    @classmethod
+    def label(cls, priority):
+        """Returns a human readable string describing a priority class"""
+        if priority in cls._labels:
+            return cls._labels[priority]
+        return 'unknown'
+
+
+class SerialWrite:
+    """Completion tracking for a queued write"""
+    def __init__(self, data, priority, trace_id=None):
+        self.data = data
+        self.priority = priority
+        self.trace_id = trace_id
+        self.queued_time = time.monotonic()
+        self.started_time = None
+        self.written_time = None
+        self.succeeded = False
+        self.cancelled = False
+        self._complete = threading.Event()
+
+    def complete(self, succeeded):
+        """Mark the write as finished"""
+        self.written_time = time.monotonic()
+        self.succeeded = succeeded
+        self._complete.set()
+
+    def wait(self, timeout=None):
+        """Block until the write has been sent. Returns True if it was written successfully"""
+        return self._complete.wait(timeout) and self.succeeded
+
+
+class PrioritySerialWriter:
+    """
+    Owns all writes to a serial port, sending queued data in priority order.
+    get_port returns the currently open port, or None if it is disconnected.
+    Writes are traced as part of the caller's trace if a Tracer is given.
+    thread_init is an optional function that is called from the writer thread when it starts.
+    """
+    def __init__(self, get_port, log_error=None, tracer=None, thread_init=None):
+        self._get_port = get_port
+        self._log_error = log_error
+        self._tracer = tracer
+        self._thread_init = thread_init
+        self._queue = queue.PriorityQueue()
+        self._sequence = itertools.count()
+        self._pending_lock = threading.Lock()
+        self._pending = []
+
+        # Per-priority [count, total latency, max latency] in seconds
+        self._latency = {p: [0, 0., 0.] for p in [WritePriority.Safety, WritePriority.Motion, WritePriority.Heartbeat]}
+
+        threading.Thread(target=self.__write_thread, name='serial-writer', daemon=True).start()
+
+    def write(self, data, priority, supersedes=None):
+        """
+        Queue data to be written to the port.
+        supersedes is an optional function that takes a pending SerialWrite and returns
+        True if it should be cancelled (reporting failure) in favour of this write.
+        Returns a SerialWrite that can be used to wait for completion.
+        """
+        write = SerialWrite(data, priority, self._tracer.current() if self._tracer is not None else None)
+        with self._pending_lock:
+            if supersedes is not None:
+                for pending in self._pending:
+                    if supersedes(pending):
+                        pending.cancelled = True
+                        pending.complete(False)
+                self._pending = [p for p in self._pending if not p.cancelled]
+
+            self._pending.append(write)
+            self._queue.put((priority, next(self._sequence), write))
+        return write
+
+    def latency(self):
+        """Returns the queue-to-write latency statistics for each priority class"""
+        stats = {}
+        for priority, (count, total, maximum) in self._latency.items():
+            stats[WritePriority.label(priority)] = {
+                'count': count,
+                'mean_ms': 1000 * total / count if count else 0,
+                'max_ms': 1000 * maximum
+            }
+        return stats
+
+    def __write_thread(self):
+        if self._thread_init is not None:
+            self._thread_init()
+
+        while True:
+            _, _, write = self._queue.get()
+            with self._pending_lock:
+                if write.cancelled:
+                    continue
+                self._pending.remove(write)
+
+            succeeded = False
+            write.started_time = time.monotonic()
+            port = self._get_port()
+            if port is not None:
+                try:
+                    succeeded = port.write(write.data) == len(write.data)
+                except Exception as exception:
+                    if self._log_error is not None:
+                        self._log_error('Failed to send serial command (' + str(exception) + ')')
+
+            write.complete(succeeded)
+            if self._tracer is not None:
+                self._tracer.record('serial_queue_wait', write.trace_id, write.queued_time, write.started_time)
+                self._tracer.record('serial_write', write.trace_id, write.started_time, write.written_time)
+
+            latency = write.written_time - write.queued_time
+            stats = self._latency[write.priority]
+            stats[0] += 1
+            stats[1] += latency
+            stats[2] = max(stats[2], latency)
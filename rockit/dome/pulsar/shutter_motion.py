@@ -0,0 +1,229 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Shutter motor state machine shared by the controller firmware, the simulator and the daemon.
+Running this file as a script prints the lookup tables compiled into the firmware:
+    python3 rockit/dome/pulsar/shutter_motion.py > shutter-controller/motion_table.h
+"""
+
+import collections
+
+# Motor directions. A moving shutter reports its direction as its status
+DIR_STOPPED = 0
+DIR_OPEN = 1
+DIR_CLOSE = 2
+VALID_DIRECTIONS = (DIR_STOPPED, DIR_OPEN, DIR_CLOSE)
+
+# Status codes reported by the controller (match ShutterStatus)
+STATUS_PART_OPEN = 0
+STATUS_OPEN = 3
+STATUS_CLOSED = 4
+
+# Actions applied by the controller after each transition, in this order
+MOTION_LIMIT_REACHED = 0x01   # Record the travel time if the move started from the opposite limit
+MOTION_TIMED_OUT = 0x02       # The move timeout stopped the motor before it reached the limit
+MOTION_FINISHED = 0x04        # Clear the move timeout
+MOTION_MEASURE_CANCEL = 0x08  # Stop timing the move
+MOTION_MEASURE_START = 0x10   # Start timing a move from the opposite limit
+MOTION_OUTPUTS_OFF = 0x20     # Disable the motor driver
+MOTION_DRIVE_OPEN = 0x40      # Enable the motor driver in the open direction
+MOTION_DRIVE_CLOSE = 0x80     # Enable the motor driver in the close direction
+
+# Table entries pack the next requested direction (bits 10-11), the next motor direction (bits 8-9) and the actions.
+# The table is indexed by the current direction (bits 5-6), requested direction (bits 3-4),
+# open limit (bit 2), closed limit (bit 1) and whether the move timeout expired on this tick (bit 0).
+MOTION_TABLE_SIZE = 128
+
+# Indexed by the motor direction (bits 2-3), open limit (bit 1) and closed limit (bit 0)
+STATUS_TABLE_SIZE = 16
+
+ACTION_NAMES = collections.OrderedDict([
+    (MOTION_LIMIT_REACHED, 'MOTION_LIMIT_REACHED'),
+    (MOTION_TIMED_OUT, 'MOTION_TIMED_OUT'),
+    (MOTION_FINISHED, 'MOTION_FINISHED'),
+    (MOTION_MEASURE_CANCEL, 'MOTION_MEASURE_CANCEL'),
+    (MOTION_MEASURE_START, 'MOTION_MEASURE_START'),
+    (MOTION_OUTPUTS_OFF, 'MOTION_OUTPUTS_OFF'),
+    (MOTION_DRIVE_OPEN, 'MOTION_DRIVE_OPEN'),
+    (MOTION_DRIVE_CLOSE, 'MOTION_DRIVE_CLOSE'),
+])
+
+DIRECTION_NAMES = ['stopped', 'open', 'close']
+
+Transition = collections.namedtuple('Transition', ['direction', 'requested', 'actions'])
+
+
+def transition(direction, requested, limit_open, limit_closed, timed_out):
+    """
+    Returns the Transition made by the controller on a timer tick.
+    direction is the current motor direction and requested the direction set by the
+    buttons, host commands or heartbeat. timed_out is True if the move timeout expired on this tick.
+    """
+    # Invalid directions stop everything
+    if direction not in VALID_DIRECTIONS or requested not in VALID_DIRECTIONS:
+        return Transition(DIR_STOPPED, DIR_STOPPED, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF)
+
+    reached_limit = (direction == DIR_OPEN and limit_open) or (direction == DIR_CLOSE and limit_closed)
+    if reached_limit or timed_out:
+        actions = MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+        if reached_limit:
+            actions |= MOTION_LIMIT_REACHED
+        elif direction != DIR_STOPPED and direction == requested:
+            actions |= MOTION_TIMED_OUT
+        return Transition(DIR_STOPPED, DIR_STOPPED, actions)
+
+    # Make sure we are stopped before changing direction
+    if direction not in (DIR_STOPPED, requested):
+        return Transition(DIR_STOPPED, requested, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF)
+
+    if requested == DIR_STOPPED:
+        return Transition(DIR_STOPPED, DIR_STOPPED, 0)
+
+    # Only moves that start from the opposite limit measure the travel time
+    actions = MOTION_DRIVE_OPEN if requested == DIR_OPEN else MOTION_DRIVE_CLOSE
+    if direction == DIR_STOPPED:
+        from_limit = limit_closed if requested == DIR_OPEN else limit_open
+        actions |= MOTION_MEASURE_START if from_limit else MOTION_MEASURE_CANCEL
+
+    return Transition(requested, requested, actions)
+
+
+def motion_index(direction, requested, limit_open, limit_closed, timed_out):
+    """Returns the MOTION_TABLE index for a set of tick inputs"""
+    return direction << 5 | requested << 3 | bool(limit_open) << 2 | bool(limit_closed) << 1 | bool(timed_out)
+
+
+def reported_status(direction, limit_open, limit_closed):
+    """Returns the status code reported by the controller"""
+    if direction != DIR_STOPPED:
+        return direction
+    if limit_open:
+        return STATUS_OPEN
+    if limit_closed:
+        return STATUS_CLOSED
+    return STATUS_PART_OPEN
+
+
+def status_index(direction, limit_open, limit_closed):
+    """Returns the STATUS_TABLE index for a motor direction and limit state"""
+    return direction << 2 | bool(limit_open) << 1 | bool(limit_closed)
+
+
+def _build_motion_table():
+    table = []
+    for index in range(MOTION_TABLE_SIZE):
+        entry = transition(index >> 5 & 3, index >> 3 & 3, index >> 2 & 1, index >> 1 & 1, index & 1)
+        table.append(entry)
+    return table
+
+
+def _build_status_table():
+    table = []
+    for index in range(STATUS_TABLE_SIZE):
+        direction = index >> 2 & 3
+        if direction not in VALID_DIRECTIONS:
+            direction = DIR_STOPPED
+        table.append(reported_status(direction, index >> 1 & 1, index & 1))
+    return table
+
+
+MOTION_TABLE = _build_motion_table()
+STATUS_TABLE = _build_status_table()
+
+
+def step(direction, requested, limit_open, limit_closed, timed_out):
+    """Looks up the Transition made by the controller on a timer tick"""
+    return MOTION_TABLE[motion_index(direction, requested, limit_open, limit_closed, timed_out)]
+
+
+def status(direction, limit_open, limit_closed):
+    """Looks up the status code reported by the controller"""
+    return STATUS_TABLE[status_index(direction, limit_open, limit_closed)]
+
+
+def move_statuses(direction):
+    """Returns the statuses reported while the shutter moves in direction and after it reaches the limit"""
+    return [status(direction, False, False), status(DIR_STOPPED, direction == DIR_OPEN, direction == DIR_CLOSE)]
+
+
+def _action_names(actions):
+    names = [name for bit, name in ACTION_NAMES.items() if actions & bit]
+    return ' | '.join(names) if names else '0'
+
+
+def generate_header():
+    """Returns the C header containing the firmware copy of the tables"""
+    lines = [
+        '// Generated by rockit/dome/pulsar/shutter_motion.py; do not edit.',
+        '// Regenerate with: make motion-table',
+        '',
+        '#ifndef MOTION_TABLE_H',
+        '#define MOTION_TABLE_H',
+        '',
+        '#include <avr/pgmspace.h>',
+        '#include <stdint.h>',
+        '',
+        f'#define DIR_STOPPED {DIR_STOPPED}',
+        f'#define DIR_OPEN {DIR_OPEN}',
+        f'#define DIR_CLOSE {DIR_CLOSE}',
+        '',
+    ]
+
+    for bit, name in ACTION_NAMES.items():
+        lines.append(f'#define {name} 0x{bit:02X}')
+
+    lines += [
+        '',
+        '#define MOTION_INDEX(direction, requested, limit_open, limit_closed, timed_out) \\',
+        '    ((direction) << 5 | (requested) << 3 | (limit_open) << 2 | (limit_closed) << 1 | (timed_out))',
+        '#define MOTION_ACTIONS(transition) ((uint8_t)(transition))',
+        '#define MOTION_DIRECTION(transition) (((transition) >> 8) & 0x03)',
+        '#define MOTION_REQUESTED(transition) (((transition) >> 10) & 0x03)',
+        '',
+        '#define STATUS_INDEX(direction, limit_open, limit_closed) \\',
+        '    ((direction) << 2 | (limit_open) << 1 | (limit_closed))',
+        '',
+        f'static const uint16_t motion_table[{MOTION_TABLE_SIZE}] PROGMEM = {{',
+    ]
+
+    for index, entry in enumerate(MOTION_TABLE):
+        value = entry.requested << 10 | entry.direction << 8 | entry.actions
+        direction, requested = index >> 5 & 3, index >> 3 & 3
+        if direction in VALID_DIRECTIONS and requested in VALID_DIRECTIONS:
+            inputs = f'{DIRECTION_NAMES[direction]}, request {DIRECTION_NAMES[requested]}'
+            inputs += ''.join([', open limit' if index & 4 else '', ', closed limit' if index & 2 else '',
+                               ', timeout' if index & 1 else ''])
+        else:
+            inputs = 'invalid'
+        lines.append(f'    0x{value:04X}, // {inputs}: {DIRECTION_NAMES[entry.direction]}, '
+                     f'request {DIRECTION_NAMES[entry.requested]}, {_action_names(entry.actions)}')
+
+    lines += [
+        '};',
+        '',
+        f'static const uint8_t status_table[{STATUS_TABLE_SIZE}] PROGMEM = {{',
+        '    ' + ', '.join(str(status) for status in STATUS_TABLE),
+        '};',
+        '',
+        '#endif',
+    ]
+
+    return '\n'.join(lines) + '\n'
+
+
+if __name__ == '__main__':
+    print(generate_header(), end='')
@@ -0,0 +1,297 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Simulated dome hardware for offline evaluation without a controller"""
+
+import threading
+import time
+from .shutter_motion import step as motion_step, status as motion_status
+from .shutter_motion import DIR_STOPPED, DIR_OPEN, DIR_CLOSE, MOTION_FINISHED, MOTION_LIMIT_REACHED, MOTION_TIMED_OUT
+from .shutter_motion import MOTION_MEASURE_CANCEL, MOTION_MEASURE_START
+from .tracking import azimuth_delta
+
+# Integration step used when advancing the simulated drive
+DRIVE_STEP_SECONDS = 0.1
+
+# The drive creeps over the last degree of each move, during which the controller
+# reports the motor as running even though the dome is within TARGET_TOLERANCE
+CREEP_DISTANCE = 1
+
+# The shutter controller timer interval, and its move timeouts in ticks
+# Must match MOVE_STEPS, MOVE_MARGIN_STEPS and MAX_MOVE_STEPS in shutter-controller/main.c
+SHUTTER_TICK_SECONDS = 0.1
+SHUTTER_MOVE_TICKS = 650
+SHUTTER_MOVE_MARGIN_TICKS = 30
+SHUTTER_MAX_MOVE_TICKS = 1200
+
+# Must match TRAVEL_FILTER_DIVISOR in shutter-controller/main.c
+SHUTTER_TRAVEL_FILTER_DIVISOR = 4
+
+
+class SimulatedAzimuthDrive:
+    """
+    Kinematic model of the azimuth drive: accelerates at a constant rate up to a maximum
+    speed and decelerates to creep_speed over the last CREEP_DISTANCE degrees of the move.
+    approach_error is the signed stopping error in degrees (positive for
+    overshoots) for moves with increasing and decreasing azimuth.
+    """
+    def __init__(self, azimuth, speed, acceleration, approach_error=(0, 0), creep_speed=0.2):
+        self.speed = speed
+        self.acceleration = acceleration
+        self.creep_speed = creep_speed
+        self.approach_error = {1: approach_error[0], -1: approach_error[1]}
+        self.stop_azimuth = azimuth
+
+        self.azimuth = azimuth
+        self.target_azimuth = azimuth
+        self.velocity = 0
+        self.moving = False
+
+        self.go_count = 0
+        self.motor_seconds = 0
+
+    @property
+    def mstate(self):
+        """Motor state code as reported in the controller's V response"""
+        return 1 if self.moving else 0
+
+    def go(self, azimuth):
+        """Start a move to the given azimuth, rounded to the controller resolution"""
+        self.target_azimuth = round(float(azimuth) % 360, 1)
+        delta = azimuth_delta(self.target_azimuth, self.azimuth)
+        direction = 1 if delta >= 0 else -1
+
+        # Moves shorter than the undershoot stall without moving
+        error = direction * max(self.approach_error[direction], -abs(delta))
+        self.stop_azimuth = (self.target_azimuth + error) % 360
+        self.go_count += 1
+        self.moving = True
+
+    def stop(self):
+        """Stop the motor immediately"""
+        self.target_azimuth = round(self.azimuth, 1)
+        self.stop_azimuth = self.azimuth
+        self.velocity = 0
+        self.moving = False
+
+    def advance(self, seconds):
+        """Integrate the drive motion forward by the given number of seconds"""
+        while self.moving and seconds > 0:
+            dt = min(seconds, DRIVE_STEP_SECONDS)
+            seconds -= dt
+            self.motor_seconds += dt
+
+            remaining = azimuth_delta(self.stop_azimuth, self.azimuth)
+            braking_distance = (self.velocity ** 2 - self.creep_speed ** 2) / (2 * self.acceleration)
+            if abs(remaining) <= CREEP_DISTANCE:
+                self.velocity = self.creep_speed
+            elif abs(remaining) - CREEP_DISTANCE <= braking_distance:
+                self.velocity = max(self.velocity - self.acceleration * dt, self.creep_speed)
+            else:
+                self.velocity = min(self.velocity + self.acceleration * dt, self.speed)
+
+            step = self.velocity * dt
+            if step >= abs(remaining):
+                self.azimuth = self.stop_azimuth
+                self.velocity = 0
+                self.moving = False
+            else:
+                self.azimuth = (self.azimuth + step * (1 if remaining > 0 else -1)) % 360
+
+
+class SimulatedAzimuthPort:
+    """
+    Stands in for the azimuth controller serial port, answering the V, GO and STOP
+    commands from a SimulatedAzimuthDrive that is advanced in real time
+    """
+    def __init__(self, drive):
+        self.drive = drive
+        self._lock = threading.Lock()
+        self._buffer = b''
+        self._last_update = time.monotonic()
+
+        # Monotonic time of the first V response to report the drive stopped after a move
+        self.stop_reported = None
+        self._reported_moving = False
+
+    def write(self, data):
+        """Handles a command sent to the controller"""
+        with self._lock:
+            now = time.monotonic()
+            self.drive.advance(now - self._last_update)
+            self._last_update = now
+
+            command = data.decode('ascii').strip()
+            if command == 'V':
+                drive = self.drive
+                fields = [f'{drive.azimuth:.1f}', str(drive.mstate), '0', f'{drive.target_azimuth:.1f}'] + ['0'] * 9
+                self._buffer += ('\t'.join(fields) + '\r').encode('ascii')
+                if self._reported_moving and not drive.moving:
+                    self.stop_reported = now
+                self._reported_moving = drive.moving
+            else:
+                if command.startswith('GO ') and command != 'GO H':
+                    self.drive.go(float(command[3:]))
+                elif command == 'STOP':
+                    self.drive.stop()
+                self._buffer += b'OK\r'
+        return len(data)
+
+    def read_until(self, expected=b'\n'):
+        """Returns the buffered response up to and including expected"""
+        with self._lock:
+            end = self._buffer.find(expected) + 1 or len(self._buffer)
+            data, self._buffer = self._buffer[:end], self._buffer[end:]
+        return data
+
+    def close(self):
+        """Provided for compatibility with serial.Serial"""
+
+
+class SimulatedShutterPort:
+    """
+    Stands in for the shutter controller serial port, reporting its status every interval seconds.
+    The motor follows the controller state machine from shutter_motion, stepped at the controller tick rate,
+    and takes travel_seconds to move between the limits. The heartbeat closes the shutter when it expires.
+    estimate_seconds is the travel time the controller has calibrated, which defaults to travel_seconds;
+    a smaller value simulates a shutter that has slowed since it was last measured.
+    """
+    def __init__(self, travel_seconds=60, interval=1, estimate_seconds=None):
+        self.travel_seconds = travel_seconds
+        self.interval = interval
+        self._lock = threading.Lock()
+
+        # Shutter position in ticks from the closed limit
+        self._travel_ticks = round(travel_seconds / SHUTTER_TICK_SECONDS)
+        self._position = 0
+
+        self._direction = DIR_STOPPED
+        self._requested = DIR_STOPPED
+        self._move_counter = 0
+        self._heartbeat = 0
+        self._heartbeat_triggered = False
+        self._tick_count = 0
+        self._last_tick = time.monotonic()
+        self._next_report = time.monotonic()
+
+        # Calibrated travel time for each direction and the timing of the active move, as in the firmware
+        estimate = round((travel_seconds if estimate_seconds is None else estimate_seconds) / SHUTTER_TICK_SECONDS)
+        self._estimate = {DIR_OPEN: estimate, DIR_CLOSE: estimate}
+        self._measuring = False
+        self._measure_ticks = 0
+
+    def __move_ticks(self, direction):
+        """Matches calibrated_timeout() in the firmware"""
+        estimate = self._estimate[direction]
+        return min(estimate + estimate // 8 + SHUTTER_MOVE_MARGIN_TICKS, SHUTTER_MAX_MOVE_TICKS)
+
+    def __update_estimate(self, direction, measured, timed_out):
+        """Matches update_travel_estimate() in the firmware"""
+        estimate = self._estimate[direction]
+        if timed_out:
+            estimate = measured
+        else:
+            estimate += int((measured - estimate) / SHUTTER_TRAVEL_FILTER_DIVISOR)
+        self._estimate[direction] = min(estimate, SHUTTER_MAX_MOVE_TICKS)
+
+    def write(self, data):
+        """Handles command bytes sent to the controller"""
+        with self._lock:
+            self.__advance()
+            for value in data:
+                if value in [0xF1, 0xF2]:
+                    if not self._heartbeat_triggered:
+                        self._requested = DIR_OPEN if value == 0xF1 else DIR_CLOSE
+                        self._move_counter = self.__move_ticks(self._requested)
+                elif value == 0xFF:
+                    if not self._heartbeat_triggered:
+                        self._requested = DIR_STOPPED
+                elif value == 0:
+                    self._heartbeat_triggered = False
+                    self._heartbeat = 0
+                    self._requested = DIR_STOPPED
+                elif value <= 240 and not self._heartbeat_triggered:
+                    self._heartbeat = value
+        return len(data)
+
+    def __advance(self):
+        """Runs the controller ticks that have elapsed since the last update"""
+        now = time.monotonic()
+        while now - self._last_tick >= SHUTTER_TICK_SECONDS:
+            self._last_tick += SHUTTER_TICK_SECONDS
+            self._tick_count += 1
+            if self._tick_count == 10:
+                self._tick_count = 0
+                if not self._heartbeat_triggered and self._heartbeat != 0:
+                    self._heartbeat -= 1
+                    if self._heartbeat == 0:
+                        self._heartbeat_triggered = True
+                        self._requested = DIR_CLOSE
+                        self._move_counter = max(self.__move_ticks(DIR_CLOSE), SHUTTER_MOVE_TICKS)
+
+            timed_out = False
+            if self._move_counter > 0:
+                self._move_counter -= 1
+                timed_out = self._move_counter == 0
+
+            transition = motion_step(self._direction, self._requested, self._position >= self._travel_ticks,
+                                     self._position <= 0, timed_out)
+            if transition.actions & (MOTION_LIMIT_REACHED | MOTION_TIMED_OUT) and self._measuring:
+                self.__update_estimate(self._direction, self._measure_ticks,
+                                       bool(transition.actions & MOTION_TIMED_OUT))
+            if transition.actions & MOTION_FINISHED:
+                self._move_counter = 0
+            if transition.actions & MOTION_MEASURE_CANCEL:
+                self._measuring = False
+            if transition.actions & MOTION_MEASURE_START:
+                self._measuring = True
+                self._measure_ticks = 0
+
+            self._direction = transition.direction
+            self._requested = transition.requested
+            if self._direction == DIR_OPEN:
+                self._position = min(self._position + 1, self._travel_ticks)
+            elif self._direction == DIR_CLOSE:
+                self._position = max(self._position - 1, 0)
+
+            if self._measuring and self._measure_ticks < SHUTTER_MAX_MOVE_TICKS:
+                self._measure_ticks += 1
+
+    def readline(self):
+        """Blocks until the next status report is due and returns it"""
+        delay = self._next_report - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+        with self._lock:
+            self._next_report = max(self._next_report + self.interval, time.monotonic())
+            self.__advance()
+
+            shutter_status = motion_status(self._direction, self._position >= self._travel_ticks, self._position <= 0)
+            heartbeat = 0xFF if self._heartbeat_triggered else self._heartbeat
+
+            # The controller reports its calibrated travel times in units of 0.1s
+            return f'{shutter_status:02d},{heartbeat:03d},{self._estimate[DIR_OPEN]:04d},' \
+                   f'{self._estimate[DIR_CLOSE]:04d}\r\n'.encode('ascii')
+
+    def reset_input_buffer(self):
+        """Provided for compatibility with serial.Serial"""
+
+    def reset_output_buffer(self):
+        """Provided for compatibility with serial.Serial"""
+
+    def close(self):
+        """Provided for compatibility with serial.Serial"""
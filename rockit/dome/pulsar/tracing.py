@@ -0,0 +1,141 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Opt-in latency tracing that writes Chrome trace-event json (load in chrome://tracing or Perfetto)"""
+
+import datetime
+import itertools
+import json
+import os
+import threading
+import time
+
+
+class _NullSpan:
+    """Shared no-op context manager returned when tracing is disabled"""
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *_):
+        return False
+
+
+NULL_SPAN = _NullSpan()
+
+
+class _Span:
+    """Times a named stage of the trace that is active on the calling thread"""
+    def __init__(self, tracer, name, trace_id, root=False):
+        self._tracer = tracer
+        self._name = name
+        self._trace_id = trace_id
+        self._root = root
+        self._previous = None
+        self._start = None
+
+    def __enter__(self):
+        if self._root:
+            self._previous = self._tracer.current()
+            self._tracer.set_current(self._trace_id)
+        self._start = time.monotonic()
+        return self
+
+    def __exit__(self, *_):
+        self._tracer.record(self._name, self._trace_id, self._start, time.monotonic())
+        if self._root:
+            self._tracer.set_current(self._previous)
+        return False
+
+
+class Tracer:
+    """
+    Records spans grouped by trace id. Each thread has a current trace that
+    is inherited by nested spans. All methods are no-ops if path is None.
+    """
+    def __init__(self, path):
+        self.enabled = path is not None
+        self._local = threading.local()
+        if not self.enabled:
+            return
+
+        self._ids = itertools.count(1)
+        self._lock = threading.Lock()
+        self._pid = os.getpid()
+        self._named_threads = set()
+
+        timestamp = datetime.datetime.now(datetime.timezone.utc).strftime('%Y%m%dT%H%M%S')
+        filename = os.path.join(path, f'pulsar_domed-{timestamp}.json')
+        # pylint: disable=consider-using-with
+        self._file = open(filename, 'w', encoding='utf-8', buffering=1)
+        # The trace-event format allows the array to be left unterminated if the daemon is killed
+        self._file.write('[\n')
+
+    def current(self):
+        """Returns the id of the trace active on the calling thread, or None"""
+        return getattr(self._local, 'trace_id', None)
+
+    def set_current(self, trace_id):
+        """Sets the trace that subsequent spans on the calling thread belong to"""
+        if self.enabled:
+            self._local.trace_id = trace_id
+
+    def new_trace_id(self):
+        """Returns an unused trace id, or None if tracing is disabled"""
+        if not self.enabled:
+            return None
+        return next(self._ids)
+
+    def trace(self, name):
+        """Starts a new trace on the calling thread, timed by a root span with the given name"""
+        if not self.enabled:
+            return NULL_SPAN
+        return _Span(self, name, self.new_trace_id(), root=True)
+
+    def span(self, name):
+        """Times a stage of the trace that is active on the calling thread"""
+        if not self.enabled:
+            return NULL_SPAN
+
+        trace_id = self.current()
+        if trace_id is None:
+            return NULL_SPAN
+        return _Span(self, name, trace_id)
+
+    def record(self, name, trace_id, start, end):
+        """Records a span with explicit time.monotonic() start and end times"""
+        if not self.enabled or trace_id is None:
+            return
+
+        thread = threading.current_thread()
+        event = {
+            'name': name,
+            'cat': 'domed',
+            'ph': 'X',
+            'ts': round(start * 1e6),
+            'dur': round((end - start) * 1e6),
+            'pid': self._pid,
+            'tid': thread.ident,
+            'args': {'trace_id': trace_id}
+        }
+
+        with self._lock:
+            if thread.ident not in self._named_threads:
+                self._named_threads.add(thread.ident)
+                self._file.write(json.dumps({
+                    'name': 'thread_name', 'ph': 'M', 'pid': self._pid, 'tid': thread.ident,
+                    'args': {'name': thread.name}
+                }) + ',\n')
+            self._file.write(json.dumps(event) + ',\n')
@@ -0,0 +1,442 @@
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Dome tracking logic shared between pulsar_domed and the offline tracking evaluator"""
+
+import collections
+import datetime
+import numpy as np
+
+# The controller reports a stalled move as mstate 0 or 3 and a homing move as mstate 9
+STOPPED_MOTOR_STATES = [0, 3]
+HOMING_MOTOR_STATE = 9
+
+# Motor often stalls within 1 deg of the target, so allow some slop
+TARGET_TOLERANCE = 1
+
+# Resolution of the azimuth accepted by the controller GO command
+GO_RESOLUTION = 0.1
+
+# Weight given to each completed move when updating the learned approach error
+APPROACH_LEARNING_RATE = 0.2
+
+# Limit on the learned approach error that is compensated for, in degrees
+MAX_APPROACH_COMPENSATION = 2
+
+# Moves shorter than this (e.g. corrective nudges) don't update the learned approach error
+MIN_LEARNING_MOVE = 2
+
+# Maximum number of corrective nudges after each move
+MAX_APPROACH_NUDGES = 2
+
+# Look this many seconds ahead to decide the direction of a tracking move
+TRACKING_LOOKAHEAD = 60
+
+# Interval in seconds between samples of the tracked trajectory when predicting the next dome move
+CLEAR_UNTIL_STEP = 1
+
+# Decision returned by AzimuthController.poll().
+# reason is one of 'settle', 'nudge', 'track', 'premove', 'defer', 'recover' or 'preslew'.
+# The loop should keep polling at the moving rate while the drive settles at the end of a move.
+# Nudges are sent directly as GO commanded; the other moves are passed to slew() with azimuth.
+# A deferred tracking move is reconsidered at the unix time deferred_until.
+AzimuthAction = collections.namedtuple('AzimuthAction', ['reason', 'azimuth', 'commanded', 'deferred_until'])
+
+
+def offset_azimuth(config, altitude, azimuth):
+    """
+    Evaluates the dome azimuth required to center a given telescope
+    azimuth in the slit. Corrects for the fact that the telescope
+    dec axis is not in the middle of the dome.
+    Accepts either scalars or numpy arrays.
+    """
+
+    # Decompose the requested az into x (south) and y (east) coords
+    x = config.dome_radius_cm * np.cos(np.radians(azimuth)) * np.cos(np.radians(altitude))
+    y = config.dome_radius_cm * np.sin(np.radians(azimuth)) * np.cos(np.radians(altitude))
+
+    # Find the vector from the telescope to the radius of the dome
+    delta_x = x - config.telescope_offset_x_cm
+    delta_y = y
+
+    corrected_az = np.degrees(np.arctan2(delta_y, delta_x))
+    return np.where(corrected_az < 0, corrected_az + 360, corrected_az)[()]
+
+
+def azimuth_delta(a, b):
+    """Returns the signed shortest angle (in degrees) to rotate from b to a"""
+    delta = a - b
+    if delta < -180:
+        delta += 360
+    if delta > 180:
+        delta -= 360
+    return delta
+
+
+def motor_is_moving(mstate, azimuth, target_azimuth):
+    """Returns True if a V status response describes a moving dome"""
+    return mstate not in STOPPED_MOTOR_STATES and \
+        (mstate == HOMING_MOTOR_STATE or abs(target_azimuth - azimuth) > TARGET_TOLERANCE)
+
+
+def go_is_redundant(commanded, azimuth, mstate, target_azimuth):
+    """
+    Returns True if a GO command would not move the dome, given the azimuth, motor state and
+    target azimuth from the latest V status: the motor is stopped with the dome already at the commanded
+    azimuth to within the controller resolution, or the motor is still driving towards the same target.
+    A dome that is passing the commanded azimuth while creeping towards a different target would not stop there.
+    """
+    commanded = round(commanded / GO_RESOLUTION) * GO_RESOLUTION % 360
+    if mstate in STOPPED_MOTOR_STATES:
+        return abs(azimuth_delta(commanded, azimuth)) < GO_RESOLUTION / 2
+
+    return mstate != HOMING_MOTOR_STATE and abs(azimuth_delta(commanded, target_azimuth)) < GO_RESOLUTION / 2
+
+
+def tracking_target(config, dome_azimuth, azimuth, future_azimuth):
+    """
+    Decides whether the dome needs to move to keep tracking.
+    dome_azimuth is the current dome position and azimuth is the required dome azimuth now.
+    future_azimuth is a function returning the required dome azimuth one minute in the future,
+    which is only evaluated if the dome needs to move.
+    Returns the azimuth to slew to, or None if the current position is acceptable.
+    """
+    if abs(azimuth_delta(azimuth, dome_azimuth)) <= config.tracking_max_separation:
+        return None
+
+    # Lead the target by the tracking tolerance to minimise the number of moves
+    future_azimuth = future_azimuth()
+    direction = 1 if future_azimuth > azimuth or future_azimuth < azimuth - 180 else -1
+    return azimuth + direction * config.tracking_max_separation
+
+
+def preslew_target(config, dome_azimuth, azimuth, next_azimuth):
+    """
+    Decides where to pre-position the dome for an upcoming target.
+    azimuth is the dome azimuth required by the current target, or None if there
+    is no current target, and next_azimuth is the dome azimuth required by the
+    upcoming target at its start time.
+    Returns the azimuth to slew to, or None if the dome should stay where it is.
+    """
+    if azimuth is None:
+        target = next_azimuth
+    else:
+        # Move as far towards the next target as possible without leaving the current one
+        limit = config.tracking_max_separation
+        target = azimuth + min(max(azimuth_delta(next_azimuth, azimuth), -limit), limit)
+
+    if abs(azimuth_delta(target, dome_azimuth)) <= TARGET_TOLERANCE:
+        return None
+
+    return target % 360
+
+
+def clear_until(config, dome_azimuth, times, azimuths):
+    """
+    Predicts when tracking will next need to move the dome.
+    times and azimuths sample the dome azimuth required by the tracked target.
+    Returns the first sample time at which the required azimuth is more than
+    tracking_max_separation from dome_azimuth, or None if it stays within the limit.
+    """
+    delta = (np.asarray(azimuths) - dome_azimuth + 180) % 360 - 180
+    outside = np.flatnonzero(np.abs(delta) > config.tracking_max_separation)
+    return float(times[outside[0]]) if len(outside) else None
+
+
+def exposure_defers_slew(config, dome_azimuth, azimuth):
+    """
+    Returns True if a tracking move requested during an exposure can wait until readout.
+    Moves are only deferred while the required azimuth stays within exposure_max_separation
+    of the dome, beyond which the beam is assumed to be vignetted anyway (0 disables deferral).
+    """
+    return config.exposure_max_separation > 0 and \
+        abs(azimuth_delta(azimuth, dome_azimuth)) <= config.exposure_max_separation
+
+
+def exposure_premove_target(config, dome_azimuth, azimuths):
+    """
+    Decides where to move the dome just before an exposure so that tracking won't need to move it
+    until readout. azimuths are the dome azimuths required over the exposure, in time order.
+    Returns the azimuth to slew to, or None if the dome should stay where it is.
+    """
+    limit = config.tracking_max_separation
+    if clear_until(config, dome_azimuth, np.arange(len(azimuths)), azimuths) is None:
+        return None
+
+    # Centre the exposure within the tracking limit if it fits, otherwise cover as much of its start as possible
+    start = float(azimuths[0])
+    span = azimuth_delta(float(azimuths[-1]), start)
+    target = start + min(max(span / 2, -limit), limit)
+    if abs(azimuth_delta(target, dome_azimuth)) <= TARGET_TOLERANCE:
+        return None
+
+    return target % 360
+
+
+def approach_needs_correction(config, residual, altitude):
+    """
+    Returns True if a move that stopped residual degrees short of (or beyond) its target
+    should be corrected. The azimuth error is scaled by cos(altitude) because it moves the
+    slit less relative to the beam as the telescope approaches the zenith.
+    altitude is the telescope altitude, or None if unknown.
+    """
+    if config.final_approach_tolerance is None:
+        return False
+
+    scale = 1 if altitude is None else np.cos(np.radians(altitude))
+    return abs(residual) * scale > config.final_approach_tolerance
+
+
+class ApproachModel:
+    """Learns the mean error of completed moves in each direction, positive for overshoots"""
+    def __init__(self):
+        self.error = {1: 0., -1: 0.}
+        self.samples = {1: 0, -1: 0}
+
+    def compensate(self, dome_azimuth, target):
+        """
+        Returns the direction of travel (1 for increasing azimuth) and the
+        azimuth to command so that the dome is expected to stop on target
+        """
+        direction = 1 if azimuth_delta(target, dome_azimuth) >= 0 else -1
+        return direction, (target - direction * self.error[direction]) % 360
+
+    def learn(self, direction, commanded, stopped):
+        """Updates the learned error from a move commanded to one azimuth that stopped at another"""
+        error = direction * azimuth_delta(stopped, commanded)
+        error = (1 - APPROACH_LEARNING_RATE) * self.error[direction] + APPROACH_LEARNING_RATE * error
+        self.error[direction] = min(max(error, -MAX_APPROACH_COMPENSATION), MAX_APPROACH_COMPENSATION)
+        self.samples[direction] += 1
+
+
+class FixedTarget:
+    """Telescope target that the dome moves to once rather than tracking"""
+    tracking = False
+
+    def __init__(self, azimuth, altitude=None):
+        self._azimuth = azimuth
+        self._altitude = altitude
+
+    def dome_azimuth(self, _):
+        """Returns the required dome azimuth"""
+        return self._azimuth
+
+    def altitude(self, _):
+        """Returns the telescope altitude, or None if unknown"""
+        return self._altitude
+
+
+class AzimuthController:
+    """
+    Decides how the azimuth loop should move the dome. Shared by pulsar_domed and the offline
+    tracking evaluator, which own the controller I/O and pass in the latest V status.
+    Targets are Trajectories or FixedTargets: objects with a tracking flag and
+    dome_azimuth(t), dome_azimuths(times) and altitude(t) methods.
+    """
+    def __init__(self, config):
+        self._config = config
+        self.approach_model = ApproachModel()
+
+        # The active move as (target, commanded azimuth, direction, distance, nudge count)
+        # and the dome azimuth from the previous poll while waiting for it to settle
+        self._approach = None
+        self._settling_azimuth = None
+
+        # Start time of the queued target that was most recently pre-slewed for
+        self._preslew_last_start = None
+
+        # Exposure that most recently deferred a tracking move
+        self._last_deferred_exposure = None
+
+        # Number of GO commands sent to the controller, and skipped because they would not move the dome
+        self.go_sent = 0
+        self.go_skipped = 0
+        self.nudges = 0
+
+        # Number of exposures that deferred a tracking move, and of moves made before an exposure starts
+        self.exposures_deferred = 0
+        self.exposures_premoved = 0
+
+    def slew(self, dome_azimuth, azimuth, mstate, target_azimuth):
+        """
+        Plans a move to azimuth, given the dome azimuth, motor state and target azimuth from the latest V status.
+        Returns the azimuth to send with GO, or None if the command would not move the dome.
+        """
+        target = azimuth % 360
+        approach = None
+        if self._config.final_approach_tolerance is not None:
+            direction, commanded = self.approach_model.compensate(dome_azimuth, target)
+            approach = (target, commanded, direction, abs(azimuth_delta(target, dome_azimuth)), 0)
+        else:
+            commanded = target
+
+        if go_is_redundant(commanded, dome_azimuth, mstate, target_azimuth):
+            self.go_skipped += 1
+            return None
+
+        self._approach = approach
+        self._settling_azimuth = None
+        self.go_sent += 1
+        return commanded
+
+    def cancel(self):
+        """Forgets the active move after it has been stopped or replaced by homing"""
+        self._approach = None
+        self._settling_azimuth = None
+
+    def poll(self, now, dome_azimuth, mstate, target, exposure, next_target):
+        """
+        Decides what the idle dome should do at unix time now.
+        dome_azimuth and mstate are from the latest V status.
+        target is the Trajectory or FixedTarget being followed, or None.
+        exposure is the (start, end) unix times of the current or next registered exposure, or None.
+        next_target is the (start unix time, dome azimuth) of the next queued target to pre-slew for, or None.
+        Returns an AzimuthAction, or None if the dome should stay where it is.
+
+        A tracking move is still made before an exposure if the dome is within TARGET_TOLERANCE
+        of the pre-move target but outside tracking_max_separation of the target now
+        (run with python3 -m doctest rockit/dome/pulsar/tracking.py):
+
+        >>> from types import SimpleNamespace
+        >>> config = SimpleNamespace(tracking_max_separation=2, exposure_max_separation=5, exposure_premove_time=30,
+        ...                          preslew_lead_time=0, final_approach_tolerance=None)
+        >>> target = SimpleNamespace(tracking=True, dome_azimuth=lambda t: 103 - t / 20,
+        ...                          dome_azimuths=lambda t: 103 - t / 20, altitude=lambda t: 45)
+        >>> exposure_premove_target(config, 100, target.dome_azimuths(np.arange(10, 111))) is None
+        True
+        >>> AzimuthController(config).poll(0, 100, 0, target, (10, 110), None)
+        AzimuthAction(reason='track', azimuth=101.0, commanded=None, deferred_until=None)
+        """
+        if self._approach is not None:
+            # The drive is reported idle once it is within TARGET_TOLERANCE, but may still be creeping
+            # towards the target. Wait until the motor stops or the position holds between two polls
+            if mstate not in STOPPED_MOTOR_STATES and (self._settling_azimuth is None or
+                                                       abs(dome_azimuth - self._settling_azimuth) >= GO_RESOLUTION / 2):
+                self._settling_azimuth = dome_azimuth
+                return AzimuthAction('settle', None, None, None)
+
+            self._settling_azimuth = None
+            commanded = self.__final_approach(dome_azimuth, target.altitude(now) if target is not None else None)
+            if commanded is not None:
+                return AzimuthAction('nudge', self._approach[0], commanded, None)
+
+        azimuth = None
+        if target is not None:
+            azimuth = target.dome_azimuth(now)
+            if target.tracking:
+                action = self.__track(now, dome_azimuth, azimuth, target, exposure)
+                if action is not None:
+                    return action
+            elif abs(azimuth_delta(azimuth, dome_azimuth)) > self._config.tracking_max_separation:
+                # Recover a fixed target whose initial slew was blocked by an earlier move
+                return AzimuthAction('recover', azimuth, None, None)
+
+        # Pre-slews for the next target wait until the current exposure has been read out
+        exposing = exposure is not None and exposure[0] <= now and self._config.exposure_max_separation > 0
+        if next_target is None or exposing or self._config.preslew_lead_time <= 0:
+            return None
+
+        start, next_azimuth = next_target
+        if start <= now or start - now > self._config.preslew_lead_time:
+            return None
+
+        # Only nudge once towards each queued target while the current target
+        # is still active, otherwise the pre-slew and tracking moves would fight
+        if azimuth is not None and start == self._preslew_last_start:
+            return None
+
+        az = preslew_target(self._config, dome_azimuth, azimuth, next_azimuth)
+        if az is None:
+            return None
+
+        self._preslew_last_start = start
+        return AzimuthAction('preslew', az, None, None)
+
+    def __track(self, now, dome_azimuth, azimuth, target, exposure):
+        """Decides whether a tracked target needs a move, taking the exposures into account"""
+        az = tracking_target(self._config, dome_azimuth, azimuth,
+                             lambda: target.dome_azimuth(now + TRACKING_LOOKAHEAD))
+        if exposure is not None and exposure[0] > now:
+            if exposure[0] - now <= self._config.exposure_premove_time:
+                # Reposition so that the dome can stay still for the whole exposure.
+                # Fall back to the tracking move if the dome is already close to the pre-move target
+                times = np.arange(exposure[0], exposure[1] + CLEAR_UNTIL_STEP, CLEAR_UNTIL_STEP)
+                premove = exposure_premove_target(self._config, dome_azimuth, target.dome_azimuths(times))
+                if premove is not None:
+                    self.exposures_premoved += 1
+                    return AzimuthAction('premove', premove, None, None)
+        elif exposure is not None and az is not None and exposure_defers_slew(self._config, dome_azimuth, azimuth):
+            if exposure != self._last_deferred_exposure:
+                self.exposures_deferred += 1
+                self._last_deferred_exposure = exposure
+            return AzimuthAction('defer', None, None, exposure[1])
+
+        return AzimuthAction('track', az, None, None) if az is not None else None
+
+    def __final_approach(self, dome_azimuth, altitude):
+        """
+        Learns from a move that has just stopped, and returns the azimuth to nudge the dome
+        towards if it stopped far enough from the target to matter, otherwise None
+        """
+        target, commanded, direction, distance, nudges = self._approach
+        self._approach = None
+        if nudges == 0 and distance >= MIN_LEARNING_MOVE:
+            self.approach_model.learn(direction, commanded, dome_azimuth)
+
+        residual = azimuth_delta(target, dome_azimuth)
+        if nudges >= MAX_APPROACH_NUDGES or not approach_needs_correction(self._config, residual, altitude):
+            return None
+
+        direction, commanded = self.approach_model.compensate(dome_azimuth, target)
+        self._approach = (target, commanded, direction, abs(residual), nudges + 1)
+        self.nudges += 1
+        self.go_sent += 1
+        return commanded
+
+
+def parse_utc_time(value):
+    """
+    Parses an ISO 8601 time string, assuming UTC if no timezone is given.
+    Returns the unix time. Raises TypeError or ValueError on invalid input.
+    """
+    parsed = datetime.datetime.fromisoformat(value.replace('Z', '+00:00'))
+    if parsed.tzinfo is None:
+        parsed = parsed.replace(tzinfo=datetime.timezone.utc)
+    return parsed.timestamp()
+
+
+def parse_queued_targets(targets):
+    """
+    Validates a list of upcoming targets passed to queue_telescope_targets.
+    Each target is a dictionary with an estimated start 'time' (ISO 8601, UTC)
+    and either 'ra'/'dec', 'alt'/'az' (degrees) or a solar system 'body'.
+    Returns a list of (start unix time, kind, args) tuples sorted by start time,
+    where kind is one of 'radec', 'altaz' or 'body'.
+    Raises KeyError, TypeError or ValueError on invalid input.
+    """
+    parsed = []
+    for target in targets:
+        start = parse_utc_time(target['time'])
+        if 'ra' in target and 'dec' in target:
+            parsed.append((start, 'radec', (float(target['ra']), float(target['dec']))))
+        elif 'alt' in target and 'az' in target:
+            parsed.append((start, 'altaz', (float(target['alt']), float(target['az']))))
+        elif 'body' in target:
+            parsed.append((start, 'body', (str(target['body']),)))
+        else:
+            raise ValueError('target must define ra/dec, alt/az or body')
+
+    return sorted(parsed, key=lambda t: t[0])
@@ -0,0 +1,273 @@
+//**********************************************************************************
+//  Copyright 2025 Paul Chote
+//  This file is part of the Robotic Observatory Control Kit (rockit)
+//
+//  rockit is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  rockit is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+//**********************************************************************************
+
+// Runs main.elf under simavr with a scripted sequence of limit, button and serial
+// stimulus, and prints the cycle counts of the firmware hot paths as json.
+// The simulation is deterministic, so the output only changes when the firmware does.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "avr_ioport.h"
+#include "avr_uart.h"
+
+#define F_CPU 16000000
+#define SIMULATED_SECONDS 16
+
+// Data space address of GPIOR2, which the firmware sets while it reports its status when built with BENCH=1
+#define GPIOR2_ADDR 0x4B
+
+// Interrupt vector numbers on the atmega32u4
+#define VECTOR_COUNT 43
+#define TIMER1_COMPA_VECTOR 17
+#define USART1_RX_VECTOR 25
+#define USART1_UDRE_VECTOR 26
+#define TIMER3_COMPA_VECTOR 32
+
+#define STIMULUS_PIN 0
+#define STIMULUS_SERIAL 1
+
+typedef struct stimulus_t {
+    double time;
+    uint8_t type;
+    char port;
+    uint8_t pin;
+    uint8_t value;
+} stimulus_t;
+
+// Limits and buttons are active low
+static const stimulus_t script[] = {
+    { 0.0, STIMULUS_PIN, 'D', 0, 0 },     // Closed limit engaged
+    { 0.0, STIMULUS_PIN, 'D', 1, 1 },     // Open limit released
+    { 0.0, STIMULUS_PIN, 'B', 1, 1 },     // Open button released
+    { 0.0, STIMULUS_PIN, 'B', 3, 1 },     // Close button released
+    { 1.0, STIMULUS_SERIAL, 0, 0, 30 },   // Heartbeat ping
+    { 1.5, STIMULUS_SERIAL, 0, 0, 0xF1 }, // Open
+    { 2.0, STIMULUS_PIN, 'D', 0, 1 },
+    { 6.0, STIMULUS_PIN, 'D', 1, 0 },     // Reached open limit
+    { 7.0, STIMULUS_SERIAL, 0, 0, 0xF2 }, // Close
+    { 7.5, STIMULUS_PIN, 'D', 1, 1 },
+    { 11.0, STIMULUS_PIN, 'D', 0, 0 },    // Reached closed limit
+    { 12.0, STIMULUS_PIN, 'B', 1, 0 },    // Hold the open button
+    { 12.5, STIMULUS_PIN, 'D', 0, 1 },
+    { 13.0, STIMULUS_PIN, 'B', 1, 1 },
+    { 14.0, STIMULUS_SERIAL, 0, 0, 0 },   // Disable heartbeat
+    { 15.0, STIMULUS_SERIAL, 0, 0, 30 },  // Burst of pings
+    { 15.0, STIMULUS_SERIAL, 0, 0, 30 },
+    { 15.0, STIMULUS_SERIAL, 0, 0, 30 },
+    { 15.0, STIMULUS_SERIAL, 0, 0, 30 },
+    { 15.0, STIMULUS_SERIAL, 0, 0, 0 },
+};
+
+typedef struct path_t {
+    const char *name;
+    uint32_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} path_t;
+
+static path_t status_path = { "poll_serial_status", 0, 0, UINT64_MAX, 0 };
+static uint64_t status_start = 0;
+static uint64_t status_isr_cycles = 0;
+static bool status_active = false;
+
+static void path_add(path_t *path, uint64_t cycles)
+{
+    path->count++;
+    path->total += cycles;
+    if (cycles < path->min)
+        path->min = cycles;
+    if (cycles > path->max)
+        path->max = cycles;
+}
+
+static void path_print(const path_t *path, bool last)
+{
+    printf("    \"%s\": {\"count\": %u, \"min_cycles\": %llu, \"mean_cycles\": %llu, \"max_cycles\": %llu}%s\n",
+        path->name, path->count, path->count ? (unsigned long long)path->min : 0,
+        path->count ? (unsigned long long)(path->total / path->count) : 0,
+        (unsigned long long)path->max, last ? "" : ",");
+}
+
+static void gpior2_write(avr_t *avr, avr_io_addr_t addr, uint8_t value, void *param)
+{
+    (void)param;
+    avr->data[addr] = value;
+
+    // Interrupts that fire during the status report are not part of its cost
+    if (value && !status_active)
+    {
+        status_start = avr->cycle;
+        status_isr_cycles = 0;
+        status_active = true;
+    }
+    else if (!value && status_active)
+    {
+        path_add(&status_path, avr->cycle - status_start - status_isr_cycles);
+        status_active = false;
+    }
+}
+
+static void uart_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    (void)value;
+    (*(uint32_t *)param)++;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s main.elf\n", argv[0]);
+        return 1;
+    }
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[1], &firmware) != 0)
+    {
+        fprintf(stderr, "error: failed to read %s\n", argv[1]);
+        return 1;
+    }
+
+    strcpy(firmware.mmcu, "atmega32u4");
+    firmware.frequency = F_CPU;
+
+    avr_t *avr = avr_make_mcu_by_name(firmware.mmcu);
+    if (!avr)
+    {
+        fprintf(stderr, "error: simavr does not support %s\n", firmware.mmcu);
+        return 1;
+    }
+
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr_register_io_write(avr, GPIOR2_ADDR, gpior2_write, NULL);
+
+    // Keep the simulated UART from echoing the status messages to stdout
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('1'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('1'), &flags);
+
+    uint32_t bytes_sent = 0;
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_OUTPUT), uart_output, &bytes_sent);
+    avr_irq_t *uart_input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'), UART_IRQ_INPUT);
+
+    path_t vectors[VECTOR_COUNT];
+    memset(vectors, 0, sizeof(vectors));
+    vectors[TIMER1_COMPA_VECTOR].name = "TIMER1_COMPA_vect";
+    vectors[USART1_RX_VECTOR].name = "USART1_RX_vect";
+    vectors[USART1_UDRE_VECTOR].name = "USART1_UDRE_vect";
+    vectors[TIMER3_COMPA_VECTOR].name = "TIMER3_COMPA_vect";
+    for (uint8_t i = 0; i < VECTOR_COUNT; i++)
+        vectors[i].min = UINT64_MAX;
+
+    int active_vector = -1;
+    uint64_t vector_start = 0;
+
+    // Interrupts-off windows are only counted once main() has enabled interrupts
+    bool interrupts_enabled = false;
+    uint64_t disabled_start = 0;
+    uint64_t disabled_max = 0;
+    avr_flashaddr_t disabled_max_pc = 0;
+    avr_flashaddr_t disabled_pc = 0;
+
+    size_t next_stimulus = 0;
+    size_t stimulus_count = sizeof(script) / sizeof(script[0]);
+    uint64_t end_cycle = (uint64_t)SIMULATED_SECONDS * F_CPU;
+
+    while (avr->cycle < end_cycle)
+    {
+        while (next_stimulus < stimulus_count && avr->cycle >= script[next_stimulus].time * F_CPU)
+        {
+            const stimulus_t *s = &script[next_stimulus++];
+            if (s->type == STIMULUS_PIN)
+                avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(s->port), s->pin), s->value);
+            else
+                avr_raise_irq(uart_input, s->value);
+        }
+
+        bool was_enabled = avr->sreg[S_I];
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed)
+        {
+            fprintf(stderr, "error: simulation stopped at pc 0x%04x\n", (unsigned)avr->pc);
+            return 1;
+        }
+
+        // Servicing an interrupt clears the I flag and jumps to the vector,
+        // and the handler ends when reti sets the I flag again
+        if (active_vector < 0 && was_enabled && !avr->sreg[S_I] &&
+            avr->pc % avr->vector_size == 0 && avr->pc / avr->vector_size < VECTOR_COUNT)
+        {
+            active_vector = avr->pc / avr->vector_size;
+            vector_start = avr->cycle;
+        }
+        else if (active_vector >= 0 && avr->sreg[S_I])
+        {
+            uint64_t cycles = avr->cycle - vector_start;
+            path_add(&vectors[active_vector], cycles);
+            if (status_active)
+                status_isr_cycles += cycles;
+            active_vector = -1;
+        }
+
+        if (!interrupts_enabled)
+        {
+            interrupts_enabled = avr->sreg[S_I];
+            disabled_start = 0;
+        }
+        else if (!avr->sreg[S_I] && !disabled_start)
+        {
+            disabled_start = avr->cycle;
+            disabled_pc = avr->pc;
+        }
+        else if (avr->sreg[S_I] && disabled_start)
+        {
+            if (avr->cycle - disabled_start > disabled_max)
+            {
+                disabled_max = avr->cycle - disabled_start;
+                disabled_max_pc = disabled_pc;
+            }
+            disabled_start = 0;
+        }
+    }
+
+    printf("{\n");
+    printf("  \"mcu\": \"%s\",\n", firmware.mmcu);
+    printf("  \"f_cpu\": %d,\n", F_CPU);
+    printf("  \"simulated_seconds\": %d,\n", SIMULATED_SECONDS);
+    printf("  \"serial_bytes_sent\": %u,\n", bytes_sent);
+    printf("  \"paths\": {\n");
+    for (uint8_t i = 0; i < VECTOR_COUNT; i++)
+        if (vectors[i].name)
+            path_print(&vectors[i], false);
+    path_print(&status_path, true);
+    printf("  },\n");
+    printf("  \"interrupts_off\": {\"max_cycles\": %llu, \"max_us\": %.1f, \"start_pc\": \"0x%04x\"}\n",
+        (unsigned long long)disabled_max, disabled_max * 1e6 / F_CPU, (unsigned)disabled_max_pc);
+    printf("}\n");
+
+    return 0;
+}
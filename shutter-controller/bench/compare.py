@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Compares the firmware cycle counts measured by bench/bench against a baseline.
+Exits with a non-zero status if any count regressed. A missing baseline only prints a warning,
+as one can only be recorded on a machine with avr-gcc and simavr installed.
+"""
+
+import argparse
+import json
+import sys
+
+
+def cycle_counts(results):
+    """Returns a dictionary of the mean and max cycle counts from a bench/bench results json"""
+    counts = {}
+    for name, path in results['paths'].items():
+        counts[f'{name} mean'] = path['mean_cycles']
+        counts[f'{name} max'] = path['max_cycles']
+    counts['interrupts_off max'] = results['interrupts_off']['max_cycles']
+    return counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compares firmware cycle counts against a baseline')
+    parser.add_argument('baseline', help='Path to the baseline json recorded by make bench-baseline')
+    parser.add_argument('results', help='Path to the results json to check')
+    parser.add_argument('--threshold', type=float, default=0.05,
+                        help='Allowed fractional increase in each cycle count relative to the baseline')
+    args = parser.parse_args()
+
+    try:
+        with open(args.baseline, 'r', encoding='utf-8') as baseline_file:
+            baseline = cycle_counts(json.load(baseline_file))
+    except FileNotFoundError:
+        print(f'warning: baseline {args.baseline} does not exist; run `make bench-baseline` '
+              'with avr-gcc and simavr installed and commit it')
+        return 0
+
+    with open(args.results, 'r', encoding='utf-8') as results_file:
+        results = cycle_counts(json.load(results_file))
+
+    regressions = []
+    for name, cycles in results.items():
+        reference = baseline.get(name)
+        if reference is None:
+            print(f'{name:>24}: {cycles:8d} cycles (not in baseline)')
+            continue
+
+        regressed = cycles > reference * (1 + args.threshold)
+        if regressed:
+            regressions.append(name)
+
+        label = 'REGRESSION' if regressed else 'ok'
+        print(f'{name:>24}: {cycles:8d} cycles ({cycles - reference:+d} vs baseline) {label}')
+
+    if regressions:
+        print('error: cycle count regressions in ' + ', '.join(regressions))
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,374 @@
+//**********************************************************************************
+//  Copyright 2025 Paul Chote
+//  This file is part of the Robotic Observatory Control Kit (rockit)
+//
+//  rockit is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  rockit is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+//**********************************************************************************
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "LUFA/Drivers/Misc/AT45DB642D.h"
+#include "blackbox.h"
+#include "gpio.h"
+#include "serial.h"
+
+// AT45DB642D in its default 1056 byte page mode
+#define PAGE_SIZE 1056
+#define PAGE_COUNT 8192
+#define PAGE_ADDRESS_SHIFT 11
+
+// Each record is the tick count (0.1s since boot) followed by the type and value.
+// Pages hold a whole number of records, and unused records are left erased (0xFF)
+#define RECORD_SIZE 6
+#define RECORDS_PER_PAGE (PAGE_SIZE / RECORD_SIZE)
+#define RECORD_ERASED 0xFFFFFFFF
+
+// Number of events that can be queued between main loop iterations (must be a power of 2)
+#define QUEUE_LENGTH 32
+
+// Program a partially filled page after this many ticks so that recent events survive
+// a power loss. Limits each page to one rewrite per 10 minutes, well within the flash endurance.
+#define FLUSH_TICKS 6000
+
+// Free serial buffer space required before sending another dump line,
+// so that the status messages can always be queued without blocking
+#define DUMP_LINE_SPACE 48
+
+// The hardware SPI pins are used by the buttons, so the dataflash is bit-banged on spare pins
+gpin_t dataflash_cs = { &PORTB, &PINB, &DDRB, PB4 };
+gpin_t dataflash_sck = { &PORTB, &PINB, &DDRB, PB5 };
+gpin_t dataflash_mosi = { &PORTB, &PINB, &DDRB, PB6 };
+gpin_t dataflash_miso = { &PORTD, &PIND, &DDRD, PD4 };
+
+typedef struct __attribute__((packed)) record_t {
+    uint32_t tick;
+    uint8_t type;
+    uint8_t value;
+} record_t;
+
+static volatile uint32_t ticks = 0;
+
+// Events waiting to be written by the main loop
+static record_t queue[QUEUE_LENGTH];
+static volatile uint8_t queue_read = 0;
+static volatile uint8_t queue_write = 0;
+static volatile uint8_t queue_dropped = 0;
+
+static bool present = false;
+
+// The page being assembled in dataflash buffer 1 and the index of its next free record.
+// The page after it is always kept erased to mark the end of the log.
+static uint16_t head_page = 0;
+static uint16_t head_record = 0;
+static bool head_dirty = false;
+static uint32_t head_flush_tick = 0;
+static bool advance_pending = false;
+static bool erase_pending = false;
+
+// Dump position, walking backwards from the newest record
+static bool dump_active = false;
+static bool dump_flush = false;
+static uint16_t dump_page = 0;
+static uint16_t dump_record = 0;
+static uint16_t dump_pages_remaining = 0;
+
+static uint8_t spi_transfer(uint8_t data)
+{
+    // SPI mode 0, MSB first
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (data & 0x80)
+            gpio_output_set_high(&dataflash_mosi);
+        else
+            gpio_output_set_low(&dataflash_mosi);
+
+        data <<= 1;
+        gpio_output_set_high(&dataflash_sck);
+        if (gpio_input_read(&dataflash_miso))
+            data |= 1;
+        gpio_output_set_low(&dataflash_sck);
+    }
+
+    return data;
+}
+
+static void dataflash_select(uint8_t command, uint16_t page, uint16_t offset)
+{
+    uint32_t address = ((uint32_t)page << PAGE_ADDRESS_SHIFT) | offset;
+    gpio_output_set_low(&dataflash_cs);
+    spi_transfer(command);
+    spi_transfer(address >> 16);
+    spi_transfer(address >> 8);
+    spi_transfer(address);
+}
+
+static void dataflash_deselect(void)
+{
+    gpio_output_set_high(&dataflash_cs);
+}
+
+static bool dataflash_ready(void)
+{
+    gpio_output_set_low(&dataflash_cs);
+    spi_transfer(DF_CMD_GETSTATUS);
+    uint8_t status = spi_transfer(0);
+    dataflash_deselect();
+    return status & DF_STATUS_READY;
+}
+
+static void dataflash_page_command(uint8_t command, uint16_t page)
+{
+    dataflash_select(command, page, 0);
+    dataflash_deselect();
+}
+
+static void dataflash_read(uint16_t page, uint16_t offset, uint8_t *data, uint8_t length)
+{
+    dataflash_select(DF_CMD_MAINMEMPAGEREAD, page, offset);
+    for (uint8_t i = 0; i < 4; i++)
+        spi_transfer(0);
+
+    for (uint8_t i = 0; i < length; i++)
+        data[i] = spi_transfer(0);
+    dataflash_deselect();
+}
+
+static uint16_t next_page(uint16_t page)
+{
+    return page == PAGE_COUNT - 1 ? 0 : page + 1;
+}
+
+static void serial_write_string(const char *str)
+{
+    while (*str)
+        serial_write(*str++);
+}
+
+void blackbox_initialize(uint8_t reset_flags)
+{
+    gpio_output_set_high(&dataflash_cs);
+    gpio_configure_output(&dataflash_cs);
+    gpio_output_set_low(&dataflash_sck);
+    gpio_configure_output(&dataflash_sck);
+    gpio_configure_output(&dataflash_mosi);
+    gpio_configure_input_pullup(&dataflash_miso);
+
+    // Leave the logger disabled if no dataflash is fitted
+    gpio_output_set_low(&dataflash_cs);
+    spi_transfer(DF_CMD_READMANUFACTURERDEVICEINFO);
+    uint8_t manufacturer = spi_transfer(0);
+    dataflash_deselect();
+
+    if (manufacturer != DF_MANUFACTURER_ATMEL)
+        return;
+
+    // Resume logging at the first erased page
+    while (!dataflash_ready());
+    for (uint16_t page = 0; page < PAGE_COUNT; page++)
+    {
+        uint32_t tick;
+        dataflash_read(page, 0, (uint8_t*)&tick, sizeof(tick));
+        if (tick == RECORD_ERASED)
+        {
+            head_page = page;
+            break;
+        }
+    }
+
+    // Loading the erased page clears the buffer
+    dataflash_page_command(DF_CMD_MAINMEMTOBUFF1, head_page);
+    while (!dataflash_ready());
+    dataflash_page_command(DF_CMD_PAGEERASE, next_page(head_page));
+
+    present = true;
+    blackbox_record(BLACKBOX_BOOT, reset_flags);
+}
+
+// Called from the timer ISR to advance the 0.1s event clock
+void blackbox_tick(void)
+{
+    ticks++;
+}
+
+// Queue an event to be written by the main loop
+// Safe to call from both ISR and main loop contexts
+void blackbox_record(uint8_t type, uint8_t value)
+{
+    if (!present)
+        return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if ((uint8_t)(queue_write - queue_read) == QUEUE_LENGTH)
+        {
+            if (queue_dropped < 0xFF)
+                queue_dropped++;
+        }
+        else
+        {
+            record_t *record = &queue[queue_write++ & (QUEUE_LENGTH - 1)];
+            record->tick = ticks;
+            record->type = type;
+            record->value = value;
+        }
+    }
+}
+
+static bool dequeue_record(record_t *record)
+{
+    bool available = true;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (queue_read != queue_write)
+            *record = queue[queue_read++ & (QUEUE_LENGTH - 1)];
+        else if (queue_dropped)
+        {
+            record->tick = ticks;
+            record->type = BLACKBOX_OVERFLOW;
+            record->value = queue_dropped;
+            queue_dropped = 0;
+        }
+        else
+            available = false;
+    }
+
+    return available;
+}
+
+static void dump_finish(void)
+{
+    serial_write_string("#END\r\n");
+    dump_active = false;
+}
+
+static void dump_next(void)
+{
+    if (serial_write_available() < DUMP_LINE_SPACE)
+        return;
+
+    if (dump_record == 0)
+    {
+        if (dump_pages_remaining == 0)
+        {
+            dump_finish();
+            return;
+        }
+
+        dump_pages_remaining--;
+        dump_page = (dump_page == 0 ? PAGE_COUNT : dump_page) - 1;
+        dump_record = RECORDS_PER_PAGE;
+    }
+
+    record_t record;
+    dump_record--;
+    dataflash_read(dump_page, dump_record * RECORD_SIZE, (uint8_t*)&record, RECORD_SIZE);
+
+    // The log ends at the first erased page; unused records at the end of a page are skipped
+    if (record.tick == RECORD_ERASED)
+    {
+        if (dump_record == 0)
+            dump_finish();
+        return;
+    }
+
+    // Lines start with # so they can't be mistaken for status messages
+    char line[24];
+    snprintf(line, sizeof(line), "#%lu,%u,%u\r\n", (unsigned long)record.tick, record.type, record.value);
+    serial_write_string(line);
+}
+
+// Called from the main loop to write queued events and send dump data.
+// Performs at most one dataflash operation per call, and returns immediately if the dataflash is busy.
+void blackbox_update(void)
+{
+    if (!present || !dataflash_ready())
+        return;
+
+    if (advance_pending)
+    {
+        // The next page is already erased, so loading it clears the buffer
+        head_page = next_page(head_page);
+        head_record = 0;
+        dataflash_page_command(DF_CMD_MAINMEMTOBUFF1, head_page);
+        advance_pending = false;
+        erase_pending = true;
+        return;
+    }
+
+    if (erase_pending)
+    {
+        dataflash_page_command(DF_CMD_PAGEERASE, next_page(head_page));
+        erase_pending = false;
+        return;
+    }
+
+    uint32_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = ticks;
+    }
+
+    if (head_record == RECORDS_PER_PAGE || dump_flush || (head_dirty && now - head_flush_tick >= FLUSH_TICKS))
+    {
+        if (head_dirty || head_record == RECORDS_PER_PAGE)
+            dataflash_page_command(DF_CMD_BUFF1TOMAINMEMWITHERASE, head_page);
+
+        advance_pending = head_record == RECORDS_PER_PAGE;
+        head_dirty = dump_flush = false;
+        head_flush_tick = now;
+        return;
+    }
+
+    record_t record;
+    if (dequeue_record(&record))
+    {
+        dataflash_select(DF_CMD_BUFF1WRITE, 0, head_record * RECORD_SIZE);
+        for (uint8_t i = 0; i < RECORD_SIZE; i++)
+            spi_transfer(((uint8_t*)&record)[i]);
+        dataflash_deselect();
+
+        head_record++;
+        head_dirty = true;
+        return;
+    }
+
+    if (dump_active)
+        dump_next();
+}
+
+// Start streaming the log over serial, newest event first, as lines of "#tick,type,value".
+// The dump covers the events recorded before it started, and ends with "#END".
+void blackbox_start_dump(void)
+{
+    if (!present)
+    {
+        serial_write_string("#END\r\n");
+        return;
+    }
+
+    dump_active = true;
+    dump_flush = true;
+    dump_page = head_page;
+    dump_record = head_record;
+    dump_pages_remaining = PAGE_COUNT - 1;
+}
+
+void blackbox_stop_dump(void)
+{
+    if (dump_active)
+        dump_finish();
+}
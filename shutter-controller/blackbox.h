@@ -0,0 +1,41 @@
+//**********************************************************************************
+//  Copyright 2025 Paul Chote
+//  This file is part of the Robotic Observatory Control Kit (rockit)
+//
+//  rockit is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  rockit is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+//**********************************************************************************
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+// Event types stored in the log
+#define BLACKBOX_BOOT 1       // value: MCUSR reset flags
+#define BLACKBOX_FLAGS 2      // value: limit, button and moving flags
+#define BLACKBOX_DIRECTION 3  // value: motor direction
+#define BLACKBOX_COMMAND 4    // value: byte received from the host
+#define BLACKBOX_HEARTBEAT 5  // value: 1 when the heartbeat close triggers
+#define BLACKBOX_TIMEOUT 6    // value: direction of a move stopped by the move timeout
+#define BLACKBOX_OVERFLOW 7   // value: number of events dropped because the queue was full
+
+void blackbox_initialize(uint8_t reset_flags);
+void blackbox_tick(void);
+void blackbox_record(uint8_t type, uint8_t value);
+void blackbox_update(void);
+void blackbox_start_dump(void);
+void blackbox_stop_dump(void);
+
+#endif
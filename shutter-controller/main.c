@@ -24,14 +24,24 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "gpio.h"
+#include "motion_table.h"
 #include "serial.h"
 
+#ifdef BLACKBOX
+#include "blackbox.h"
+#endif
+
 // Amount of time to power the motors in units of 0.1s
+// Used until a travel time has been measured, and as the minimum for a heartbeat close
 #define MOVE_STEPS 650
 
-#define DIR_STOPPED 0
-#define DIR_OPEN 1
-#define DIR_CLOSE 2
+// The calibrated move timeout is the filtered travel time plus 12.5% and MOVE_MARGIN_STEPS,
+// capped at MAX_MOVE_STEPS (in units of 0.1s). Must match SHUTTER_TRAVEL_* in pulsar_domed
+#define MOVE_MARGIN_STEPS 30
+#define MAX_MOVE_STEPS 1200
+
+// Each new travel time measurement is given a weight of 1/4 in the filtered estimate
+#define TRAVEL_FILTER_DIVISOR 4
 
 // Open/close flags should match open/close direction bits
 #define FLAG_LIMIT_OPEN 1
@@ -40,7 +50,7 @@
 #define FLAG_BUTTON_OPEN 8
 #define FLAG_BUTTON_CLOSE 16
 
-char output_buffer[16];
+char output_buffer[24];
 
 volatile uint8_t requested_direction = DIR_STOPPED;
 volatile uint8_t current_direction = DIR_STOPPED;
@@ -49,6 +59,22 @@ volatile uint16_t move_counter = 0;
 volatile uint8_t status_counter = 0;
 volatile bool send_status = false;
 
+// Filtered limit-to-limit travel time for each direction in units of 0.1s, or 0 if not yet measured
+// Indexed by direction - 1
+uint16_t EEMEM travel_estimate_eeprom[2];
+volatile uint16_t travel_estimate[2] = { 0, 0 };
+volatile uint16_t move_timeout[2] = { MOVE_STEPS, MOVE_STEPS };
+
+// Time since the start of a move that started from the opposite limit
+volatile bool travel_measuring = false;
+volatile uint16_t travel_counter = 0;
+
+// A completed measurement waiting to be added to the estimate by the main loop
+// travel_timed_out is set if the move timed out before reaching the limit, so the travel time is at least travel_measured
+volatile uint16_t travel_measured = 0;
+volatile uint8_t travel_measured_direction = DIR_STOPPED;
+volatile bool travel_timed_out = false;
+
 // Number of seconds remaining until triggering the force-close
 volatile uint8_t heartbeat_seconds_remaining = 0;
 
@@ -56,6 +82,12 @@ volatile uint8_t heartbeat_seconds_remaining = 0;
 // and is either closing or has closed the roof.
 volatile bool heartbeat_triggered = false;
 
+#ifdef BLACKBOX
+// Last flags and direction written to the black-box log
+uint8_t logged_flags = 0;
+uint8_t logged_direction = DIR_STOPPED;
+#endif
+
 gpin_t drive_en_l = { &PORTF, &PINF, &DDRF, PF4 };
 gpin_t drive_en_r = { &PORTF, &PINF, &DDRF, PF5 };
 gpin_t drive_pwm_l = { &PORTF, &PINF, &DDRF, PF6 };
@@ -67,6 +99,63 @@ gpin_t button_close = { &PORTB, &PINB, &DDRB, PB3 };
 gpin_t limit_open = { &PORTD, &PIND, &DDRD, PD1 };
 gpin_t limit_closed = { &PORTD, &PIND, &DDRD, PD0 };
 
+uint16_t calibrated_timeout(uint16_t estimate)
+{
+    if (estimate == 0)
+        return MOVE_STEPS;
+
+    uint32_t timeout = (uint32_t)estimate + estimate / 8 + MOVE_MARGIN_STEPS;
+    return timeout > MAX_MOVE_STEPS ? MAX_MOVE_STEPS : timeout;
+}
+
+void load_travel_estimates(void)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        // Unprogrammed EEPROM reads as 0xFFFF
+        uint16_t estimate = eeprom_read_word(&travel_estimate_eeprom[i]);
+        if (estimate > MAX_MOVE_STEPS)
+            estimate = 0;
+
+        travel_estimate[i] = estimate;
+        move_timeout[i] = calibrated_timeout(estimate);
+    }
+}
+
+void update_travel_estimate(void)
+{
+    cli();
+    uint16_t measured = travel_measured;
+    uint8_t direction = travel_measured_direction;
+    bool timed_out = travel_timed_out;
+    travel_measured = 0;
+    travel_timed_out = false;
+    sei();
+
+    if (measured == 0)
+        return;
+
+    uint8_t i = direction - 1;
+    int32_t estimate = travel_estimate[i];
+
+    // A shutter that has slowed past the timeout would otherwise be cut off at the same point on every move
+    if (timed_out || estimate == 0)
+        estimate = measured;
+    else
+        estimate += ((int32_t)measured - estimate) / TRAVEL_FILTER_DIVISOR;
+
+    if (estimate > MAX_MOVE_STEPS)
+        estimate = MAX_MOVE_STEPS;
+
+    cli();
+    travel_estimate[i] = estimate;
+    move_timeout[i] = calibrated_timeout(estimate);
+    sei();
+
+    // Only writes if the value has changed, so a stable estimate doesn't wear the EEPROM
+    eeprom_update_word(&travel_estimate_eeprom[i], estimate);
+}
+
 void poll_serial(void)
 {
     // Check for commands from the host PC
@@ -75,7 +164,11 @@ void poll_serial(void)
         int16_t value = serial_read();
         if (value < 0)
             break;
-        
+
+#ifdef BLACKBOX
+        blackbox_record(BLACKBOX_COMMAND, value);
+#endif
+
         // Values between 0-240 are treated as heartbeat pings
         // Values greater than 240 (0xF0) are reserved for commands
         switch (value)
@@ -86,7 +179,7 @@ void poll_serial(void)
                 {
                     cli();
                     requested_direction = DIR_OPEN;
-                    move_counter = MOVE_STEPS;
+                    move_counter = move_timeout[DIR_OPEN - 1];
                     sei();
                 }
                 break;
@@ -97,11 +190,23 @@ void poll_serial(void)
                 {
                     cli();
                     requested_direction = DIR_CLOSE;
-                    move_counter = MOVE_STEPS;
+                    move_counter = move_timeout[DIR_CLOSE - 1];
                     sei();
                 }
             break;
 
+#ifdef BLACKBOX
+            // Stream the black-box log, newest event first
+            case 0xF3:
+                blackbox_start_dump();
+                break;
+
+            // Cancel an active log dump
+            case 0xF4:
+                blackbox_stop_dump();
+                break;
+#endif
+
             // Stop shutter movement
             case 0xFF:
                 if (!heartbeat_triggered)
@@ -131,25 +236,32 @@ void poll_serial(void)
 
     if (send_status)
     {
+#ifdef BENCH
+        // GPIOR2 is otherwise unused, and marks the status report for the cycle benchmark (bench/bench.c)
+        GPIOR2 = 1;
+#endif
+
         // Send current status back to the host computer
         // Disable interrupts while updating to ensure data consistency
         cli();
         uint8_t heartbeat = heartbeat_triggered ? 0xFF : heartbeat_seconds_remaining;
-        uint8_t state = DIR_STOPPED;
-        if (current_flags & FLAG_MOVING)
-            state = current_direction;
-        else if (current_flags & FLAG_LIMIT_OPEN)
-            state = DIR_OPEN + 2;
-        else if (current_flags & FLAG_LIMIT_CLOSED)
-            state = DIR_CLOSE + 2;
-        
-        snprintf(output_buffer, 16, "%02d,%03d\r\n", state, heartbeat);
+        uint8_t state = pgm_read_byte(&status_table[STATUS_INDEX(current_direction,
+            (current_flags & FLAG_LIMIT_OPEN) ? 1 : 0, (current_flags & FLAG_LIMIT_CLOSED) ? 1 : 0)]);
+
+        uint16_t open_estimate = travel_estimate[DIR_OPEN - 1];
+        uint16_t close_estimate = travel_estimate[DIR_CLOSE - 1];
         sei();
 
-        for (uint8_t i = 0; i < 8; i++)
+        int length = snprintf(output_buffer, sizeof(output_buffer), "%02d,%03d,%04u,%04u\r\n",
+            state, heartbeat, open_estimate, close_estimate);
+
+        for (uint8_t i = 0; i < length; i++)
             serial_write(output_buffer[i]);
 
         send_status = false;
+#ifdef BENCH
+        GPIOR2 = 0;
+#endif
     }
 }
 
@@ -177,10 +289,24 @@ int main(void)
     TIMSK1 |= _BV(OCIE1A);
 
     serial_initialize();
+    load_travel_estimates();
+
+#ifdef BLACKBOX
+    // Log (and clear) the cause of the reset
+    uint8_t reset_flags = MCUSR;
+    MCUSR = 0;
+    blackbox_initialize(reset_flags);
+#endif
 
     sei();
     for (;;)
+    {
         poll_serial();
+        update_travel_estimate();
+#ifdef BLACKBOX
+        blackbox_update();
+#endif
+    }
 }
 
 ISR(TIMER1_COMPA_vect)
@@ -197,7 +323,13 @@ ISR(TIMER1_COMPA_vect)
             {
                 heartbeat_triggered = true;
                 requested_direction = DIR_CLOSE;
-                move_counter = MOVE_STEPS;
+#ifdef BLACKBOX
+                blackbox_record(BLACKBOX_HEARTBEAT, 1);
+#endif
+
+                // Never give up on a safety close earlier than the uncalibrated timeout
+                uint16_t timeout = move_timeout[DIR_CLOSE - 1];
+                move_counter = timeout > MOVE_STEPS ? timeout : MOVE_STEPS;
             }
         }
     }
@@ -251,44 +383,91 @@ ISR(TIMER1_COMPA_vect)
         current_flags &= ~FLAG_BUTTON_CLOSE;        
     }      
 
-    if ((current_direction == DIR_OPEN && (current_flags & FLAG_LIMIT_OPEN)) ||
-        (current_direction == DIR_CLOSE && (current_flags & FLAG_LIMIT_CLOSED)) ||
-        (move_counter > 0 && --move_counter == 0))
+    // The next motor state is looked up from the limits, the requested direction and the move timeout.
+    // The table is generated from rockit/dome/pulsar/shutter_motion.py, which is shared with the daemon and simulator
+    bool timed_out = move_counter > 0 && --move_counter == 0;
+    uint16_t transition = pgm_read_word(&motion_table[MOTION_INDEX(current_direction, requested_direction,
+        (current_flags & FLAG_LIMIT_OPEN) ? 1 : 0, (current_flags & FLAG_LIMIT_CLOSED) ? 1 : 0, timed_out)]);
+    uint8_t actions = MOTION_ACTIONS(transition);
+
+    // Only complete limit-to-limit moves measure the travel time
+    if ((actions & MOTION_LIMIT_REACHED) && travel_measuring)
     {
-        gpio_output_set_low(&drive_en_l);
-        gpio_output_set_low(&drive_en_r);
-        current_direction = requested_direction = DIR_STOPPED;
+        travel_measured = travel_counter;
+        travel_measured_direction = current_direction;
+    }
+
+    if (actions & MOTION_TIMED_OUT)
+    {
+        if (travel_measuring)
+        {
+            travel_measured = travel_counter;
+            travel_measured_direction = current_direction;
+            travel_timed_out = true;
+        }
+
+#ifdef BLACKBOX
+        blackbox_record(BLACKBOX_TIMEOUT, current_direction);
+#endif
+    }
+
+    if (actions & MOTION_FINISHED)
         move_counter = 0;
+
+    if (actions & MOTION_MEASURE_CANCEL)
+        travel_measuring = false;
+
+    if (actions & MOTION_MEASURE_START)
+    {
+        travel_measuring = true;
+        travel_counter = 0;
     }
-    
-    // Make sure we are stopped before changing direction
-    if (current_direction != DIR_STOPPED && requested_direction != current_direction)
+
+    if (actions & MOTION_OUTPUTS_OFF)
     {
         gpio_output_set_low(&drive_en_l);
         gpio_output_set_low(&drive_en_r);
-        current_direction = DIR_STOPPED;
     }
-    else if (requested_direction == DIR_OPEN)
+    else if (actions & MOTION_DRIVE_OPEN)
     {
         gpio_output_set_high(&drive_pwm_l);
         gpio_output_set_low(&drive_pwm_r);
 
         gpio_output_set_high(&drive_en_l);
         gpio_output_set_high(&drive_en_r);
-        current_direction = DIR_OPEN;
     }
-    else if (requested_direction == DIR_CLOSE)
+    else if (actions & MOTION_DRIVE_CLOSE)
     {
         gpio_output_set_low(&drive_pwm_l);
         gpio_output_set_high(&drive_pwm_r);
 
         gpio_output_set_high(&drive_en_l);
         gpio_output_set_high(&drive_en_r);
-        current_direction = DIR_CLOSE;
     }
-    
+
+    current_direction = MOTION_DIRECTION(transition);
+    requested_direction = MOTION_REQUESTED(transition);
+
+    if (travel_measuring && travel_counter < MAX_MOVE_STEPS)
+        travel_counter++;
+
     if (current_direction != DIR_STOPPED)
         current_flags |= FLAG_MOVING;
     else
         current_flags &= ~FLAG_MOVING;
+
+#ifdef BLACKBOX
+    blackbox_tick();
+    if (current_flags != logged_flags)
+    {
+        blackbox_record(BLACKBOX_FLAGS, current_flags);
+        logged_flags = current_flags;
+    }
+
+    if (current_direction != logged_direction)
+    {
+        blackbox_record(BLACKBOX_DIRECTION, current_direction);
+        logged_direction = current_direction;
+    }
+#endif
 }
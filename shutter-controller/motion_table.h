@@ -0,0 +1,167 @@
+// Generated by rockit/dome/pulsar/shutter_motion.py; do not edit.
+// Regenerate with: make motion-table
+
+#ifndef MOTION_TABLE_H
+#define MOTION_TABLE_H
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+#define DIR_STOPPED 0
+#define DIR_OPEN 1
+#define DIR_CLOSE 2
+
+#define MOTION_LIMIT_REACHED 0x01
+#define MOTION_TIMED_OUT 0x02
+#define MOTION_FINISHED 0x04
+#define MOTION_MEASURE_CANCEL 0x08
+#define MOTION_MEASURE_START 0x10
+#define MOTION_OUTPUTS_OFF 0x20
+#define MOTION_DRIVE_OPEN 0x40
+#define MOTION_DRIVE_CLOSE 0x80
+
+#define MOTION_INDEX(direction, requested, limit_open, limit_closed, timed_out) \
+    ((direction) << 5 | (requested) << 3 | (limit_open) << 2 | (limit_closed) << 1 | (timed_out))
+#define MOTION_ACTIONS(transition) ((uint8_t)(transition))
+#define MOTION_DIRECTION(transition) (((transition) >> 8) & 0x03)
+#define MOTION_REQUESTED(transition) (((transition) >> 10) & 0x03)
+
+#define STATUS_INDEX(direction, limit_open, limit_closed) \
+    ((direction) << 2 | (limit_open) << 1 | (limit_closed))
+
+static const uint16_t motion_table[128] PROGMEM = {
+    0x0000, // stopped, request stopped: stopped, request stopped, 0
+    0x002C, // stopped, request stopped, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0000, // stopped, request stopped, closed limit: stopped, request stopped, 0
+    0x002C, // stopped, request stopped, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0000, // stopped, request stopped, open limit: stopped, request stopped, 0
+    0x002C, // stopped, request stopped, open limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0000, // stopped, request stopped, open limit, closed limit: stopped, request stopped, 0
+    0x002C, // stopped, request stopped, open limit, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0548, // stopped, request open: open, request open, MOTION_MEASURE_CANCEL | MOTION_DRIVE_OPEN
+    0x002C, // stopped, request open, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0550, // stopped, request open, closed limit: open, request open, MOTION_MEASURE_START | MOTION_DRIVE_OPEN
+    0x002C, // stopped, request open, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0548, // stopped, request open, open limit: open, request open, MOTION_MEASURE_CANCEL | MOTION_DRIVE_OPEN
+    0x002C, // stopped, request open, open limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0550, // stopped, request open, open limit, closed limit: open, request open, MOTION_MEASURE_START | MOTION_DRIVE_OPEN
+    0x002C, // stopped, request open, open limit, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0A88, // stopped, request close: close, request close, MOTION_MEASURE_CANCEL | MOTION_DRIVE_CLOSE
+    0x002C, // stopped, request close, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0A88, // stopped, request close, closed limit: close, request close, MOTION_MEASURE_CANCEL | MOTION_DRIVE_CLOSE
+    0x002C, // stopped, request close, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0A90, // stopped, request close, open limit: close, request close, MOTION_MEASURE_START | MOTION_DRIVE_CLOSE
+    0x002C, // stopped, request close, open limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0A90, // stopped, request close, open limit, closed limit: close, request close, MOTION_MEASURE_START | MOTION_DRIVE_CLOSE
+    0x002C, // stopped, request close, open limit, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0028, // open, request stopped: stopped, request stopped, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // open, request stopped, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0028, // open, request stopped, closed limit: stopped, request stopped, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // open, request stopped, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request stopped, open limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request stopped, open limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request stopped, open limit, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request stopped, open limit, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0540, // open, request open: open, request open, MOTION_DRIVE_OPEN
+    0x002E, // open, request open, timeout: stopped, request stopped, MOTION_TIMED_OUT | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0540, // open, request open, closed limit: open, request open, MOTION_DRIVE_OPEN
+    0x002E, // open, request open, closed limit, timeout: stopped, request stopped, MOTION_TIMED_OUT | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request open, open limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request open, open limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request open, open limit, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request open, open limit, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0828, // open, request close: stopped, request close, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // open, request close, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0828, // open, request close, closed limit: stopped, request close, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // open, request close, closed limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request close, open limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request close, open limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request close, open limit, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // open, request close, open limit, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0028, // close, request stopped: stopped, request stopped, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // close, request stopped, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request stopped, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request stopped, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0028, // close, request stopped, open limit: stopped, request stopped, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // close, request stopped, open limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request stopped, open limit, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request stopped, open limit, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0428, // close, request open: stopped, request open, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // close, request open, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request open, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request open, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0428, // close, request open, open limit: stopped, request open, MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // close, request open, open limit, timeout: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request open, open limit, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request open, open limit, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0A80, // close, request close: close, request close, MOTION_DRIVE_CLOSE
+    0x002E, // close, request close, timeout: stopped, request stopped, MOTION_TIMED_OUT | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request close, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request close, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x0A80, // close, request close, open limit: close, request close, MOTION_DRIVE_CLOSE
+    0x002E, // close, request close, open limit, timeout: stopped, request stopped, MOTION_TIMED_OUT | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request close, open limit, closed limit: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002D, // close, request close, open limit, closed limit, timeout: stopped, request stopped, MOTION_LIMIT_REACHED | MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+    0x002C, // invalid: stopped, request stopped, MOTION_FINISHED | MOTION_MEASURE_CANCEL | MOTION_OUTPUTS_OFF
+};
+
+static const uint8_t status_table[16] PROGMEM = {
+    0, 4, 3, 3, 1, 1, 1, 1, 2, 2, 2, 2, 0, 4, 3, 3
+};
+
+#endif
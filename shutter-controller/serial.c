@@ -80,6 +80,12 @@ uint8_t serial_read(void)
     return input_buffer[input_read++];
 }
 
+// Number of bytes that can be added to the send buffer without blocking
+uint8_t serial_write_available(void)
+{
+    return (uint8_t)(output_read - output_write - 1);
+}
+
 // Add a byte to the send buffer.
 // Will block if the buffer is full
 void serial_write(uint8_t b)
@@ -25,6 +25,7 @@
 void serial_initialize(void);
 bool serial_can_read(void);
 uint8_t serial_read(void);
+uint8_t serial_write_available(void);
 void serial_write(uint8_t b);
 
 #endif
@@ -3,15 +3,58 @@ import serial
 import sys
 import time
 
+# Black-box event types (see shutter-controller/blackbox.h)
+BLACKBOX_EVENTS = {
+    1: 'boot',
+    2: 'flags',
+    3: 'direction',
+    4: 'command',
+    5: 'heartbeat',
+    6: 'timeout',
+    7: 'overflow'
+}
+
+
+def download_blackbox(port, path):
+    """Streams the black-box log (newest event first) to a csv file until it ends or ctrl-c is pressed"""
+    count = 0
+    with open(path, 'w', encoding='ascii') as output:
+        output.write('tick,event,value\n')
+        port.write(b'\xf3')
+        try:
+            while True:
+                line = port.readline().decode('ascii').strip()
+                if not line.startswith('#'):
+                    continue
+
+                if line == '#END':
+                    break
+
+                tick, event, value = line[1:].split(',')
+                output.write(f'{tick},{BLACKBOX_EVENTS.get(int(event), event)},{value}\n')
+                count += 1
+                if count % 100 == 0:
+                    print(f'Downloaded {count} events', end='\r')
+        except KeyboardInterrupt:
+            port.write(b'\xf4')
+
+    print(f'Downloaded {count} events to {path}')
+
+
 if __name__ == '__main__':
     parser = argparse.ArgumentParser()
     parser.add_argument('port', help='Port device', type=str)
     parser.add_argument('--open', help='Open the roof', action='store_true')
     parser.add_argument('--close', help='Close the roof', action='store_true')
     parser.add_argument('--heartbeat', help='Set a heartbeat value', default=-1, type=int)
+    parser.add_argument('--download', help='Save the black-box event log to a csv file', type=str)
     args = parser.parse_args()
     
     port = serial.Serial(args.port, 4800, 5)
+    if args.download:
+        download_blackbox(port, args.download)
+        sys.exit(0)
+
     if args.open:
         port.write(b'\xf1')
     elif args.close:
@@ -0,0 +1,480 @@
+#!/usr/bin/env python3
+#
+# This file is part of the Robotic Observatory Control Kit (rockit)
+#
+# rockit is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# rockit is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with rockit.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+Offline tracking-quality evaluator.
+Replays a target log recorded by pulsar_domed (see `target_log_path`) through the
+daemon tracking logic against a simulated azimuth drive and reports how well the
+dome kept the telescope beam clear of the slit.
+"""
+
+# pylint: disable=too-many-locals,too-many-branches,too-many-statements,too-many-nested-blocks
+
+import argparse
+import copy
+import itertools
+import json
+import sys
+from astropy.coordinates import AltAz, EarthLocation, get_body, SkyCoord
+from astropy.time import Time
+import astropy.units as u
+import numpy as np
+from rockit.dome.pulsar import Config
+from rockit.dome.pulsar.simulator import SimulatedAzimuthDrive
+from rockit.dome.pulsar.tracking import azimuth_delta, motor_is_moving, offset_azimuth, parse_queued_targets
+from rockit.dome.pulsar.tracking import AzimuthController, TRACKING_LOOKAHEAD
+
+
+class Segment:
+    """Telescope pointing between two consecutive notifications"""
+    def __init__(self, call, args, start, end):
+        self.call = call
+        self.args = args
+        self.start = start
+        self.end = end
+
+        # Telescope alt/az over [start, end + lookahead) grid samples, or None if there is no target
+        self.alt = None
+        self.az = None
+
+        # Unix times of the alt/az samples, and the (unwrapped) required dome azimuth for the active configuration
+        self.times = None
+        self.required = None
+
+    @property
+    def tracking(self):
+        """True if the daemon would continue to track this target after the initial slew"""
+        return self.call == 'notify_telescope_target_body' or \
+            (self.call == 'notify_telescope_target_radec' and self.args[2])
+
+    def dome_azimuth(self, unix_time):
+        """Returns the dome azimuth required at the given unix time"""
+        return float(np.interp(unix_time, self.times, self.required) % 360)
+
+    def dome_azimuths(self, unix_times):
+        """Returns the dome azimuth required at each of an array of unix times"""
+        return np.interp(unix_times, self.times, self.required) % 360
+
+    def altitude(self, unix_time):
+        """Returns the telescope altitude at the given unix time"""
+        return float(np.interp(unix_time, self.times, self.alt))
+
+
+class QueuedTarget:
+    """Upcoming target pushed by queue_telescope_targets"""
+    def __init__(self, start, kind, args):
+        self.start = start
+        self.kind = kind
+        self.args = args
+
+        # Telescope alt/az at the estimated start time
+        self.alt = None
+        self.az = None
+
+        # Required dome azimuth for the active configuration
+        self.required = None
+
+
+class Exposure:
+    """Camera exposure registered by notify_exposure or generated by --exposure-time"""
+    def __init__(self, registered, start, end):
+        # Unix times that the daemon learns about the exposure, and that it starts and ends
+        self.registered = registered
+        self.start = start
+        self.end = end
+
+
+def load_log(path):
+    """Parses a json-lines target log, returning a time-sorted list of (unix time, call, args)"""
+    calls = []
+    with open(path, 'r', encoding='utf-8') as log_file:
+        for line in log_file:
+            line = line.strip()
+            if line:
+                entry = json.loads(line)
+                calls.append((float(entry['time']), entry['call'], entry.get('args', [])))
+    return sorted(calls, key=lambda c: c[0])
+
+
+def interpolate_azimuth(times, sample_times, azimuth):
+    """Interpolates a sampled azimuth series, handling the wrap at 360 deg"""
+    unwrapped = np.degrees(np.unwrap(np.radians(azimuth)))
+    return np.interp(times, sample_times, unwrapped) % 360
+
+
+def evaluate_astrometry(segments, grid, location, astrometry_step):
+    """Fills in the telescope alt/az for each segment using vectorized transforms"""
+    step = grid[1] - grid[0] if len(grid) > 1 else 1
+    lookahead = int(np.ceil(TRACKING_LOOKAHEAD / step))
+    for segment in segments:
+        count = segment.end - segment.start + lookahead
+        times = grid[0] + (segment.start + np.arange(count)) * step
+
+        if segment.call == 'notify_telescope_target_altaz':
+            segment.alt = np.full(count, float(segment.args[0]))
+            segment.az = np.full(count, float(segment.args[1]))
+            continue
+
+        if segment.call not in ['notify_telescope_target_radec', 'notify_telescope_target_body']:
+            continue
+
+        if segment.tracking:
+            sample_times = np.arange(times[0], times[-1] + astrometry_step, astrometry_step)
+        else:
+            # The telescope stays at the alt/az of the target at the time of the notification
+            sample_times = times[:1]
+
+        obstime = Time(sample_times, format='unix')
+        frame = AltAz(obstime=obstime, location=location)
+        if segment.call == 'notify_telescope_target_body':
+            altaz = get_body(segment.args[0], obstime, location).transform_to(frame)
+        else:
+            coord = SkyCoord(ra=segment.args[0], dec=segment.args[1], unit=u.deg, frame='icrs')
+            altaz = coord.transform_to(frame)
+
+        alt = np.atleast_1d(altaz.alt.to_value(u.deg))
+        az = np.atleast_1d(altaz.az.to_value(u.deg))
+        if len(sample_times) == 1:
+            segment.alt = np.full(count, alt[0])
+            segment.az = np.full(count, az[0])
+        else:
+            segment.alt = np.interp(times, sample_times, alt)
+            segment.az = interpolate_azimuth(times, sample_times, az)
+
+
+def evaluate_queued_astrometry(queue_events, location):
+    """Fills in the telescope alt/az for each queued target at its estimated start time"""
+    targets = [t for _, queued in queue_events for t in queued]
+    for target in targets:
+        if target.kind == 'altaz':
+            target.alt, target.az = target.args
+        elif target.kind == 'body':
+            obstime = Time(target.start, format='unix')
+            altaz = get_body(target.args[0], obstime, location).transform_to(
+                AltAz(obstime=obstime, location=location))
+            target.alt, target.az = altaz.alt.to_value(u.deg), altaz.az.to_value(u.deg)
+
+    radec = [t for t in targets if t.kind == 'radec']
+    if radec:
+        obstime = Time([t.start for t in radec], format='unix')
+        coords = SkyCoord(ra=[t.args[0] for t in radec], dec=[t.args[1] for t in radec], unit=u.deg, frame='icrs')
+        altaz = coords.transform_to(AltAz(obstime=obstime, location=location))
+        for target, alt, az in zip(radec, altaz.alt.to_value(u.deg), altaz.az.to_value(u.deg)):
+            target.alt, target.az = alt, az
+
+
+def synthesize_exposures(segments, grid, exposure_time, readout_time, acquisition_time):
+    """
+    Returns a list of back-to-back Exposures covering each tracked target, starting
+    acquisition_time seconds after the notification and separated by readout_time
+    """
+    step = grid[1] - grid[0] if len(grid) > 1 else 1
+    exposures = []
+    for segment in segments:
+        if not segment.tracking:
+            continue
+
+        registered = grid[0] + segment.start * step
+        start = registered + acquisition_time
+        while start + exposure_time <= grid[0] + segment.end * step:
+            exposures.append(Exposure(registered, start, start + exposure_time))
+            start += exposure_time + readout_time
+    return exposures
+
+
+def replay(config, segments, queue_events, exposures, grid, drive, *, clearance_cm):
+    """
+    Runs the daemon azimuth loop against a simulated drive.
+    queue_events is a list of (grid index, [QueuedTarget]) from queue_telescope_targets calls.
+    exposures is a list of Exposures sorted by start time. An exposure is ruined if the dome
+    moves or the beam is vignetted at any point during it.
+    clearance_cm is the free space between the beam and each edge of the slit.
+    Returns a dictionary of tracking quality metrics.
+    """
+    step = grid[1] - grid[0] if len(grid) > 1 else 1
+    for segment in segments:
+        if segment.alt is not None:
+            segment.times = grid[0] + (segment.start + np.arange(len(segment.alt))) * step
+            segment.required = np.degrees(np.unwrap(np.radians(offset_azimuth(config, segment.alt, segment.az))))
+
+    for _, targets in queue_events:
+        for target in targets:
+            target.required = float(offset_azimuth(config, target.alt, target.az))
+
+    segment = None
+    segment_index = -1
+    queue_index = -1
+    queued = []
+    moving = False
+    dome_azimuth = drive.azimuth
+    next_poll = 0
+
+    on_target_steps = 0
+    vignetted_steps = 0
+
+    # Makes the same decisions as the daemon azimuth thread
+    controller = AzimuthController(config)
+    exposure_index = 0
+    ruined = set()
+    deferred_until = None
+
+    # Time from each target notification until the dome comes to rest, split by whether it was pre-slewed
+    preslew_active = False
+    wait_start = None
+    wait_preslewed = False
+    waits = {True: [], False: []}
+
+    def update_state():
+        nonlocal moving, dome_azimuth
+        moving = motor_is_moving(drive.mstate, drive.azimuth, drive.target_azimuth)
+        dome_azimuth = drive.azimuth
+
+    def slew(azimuth):
+        nonlocal moving
+        if moving:
+            return
+
+        commanded = controller.slew(dome_azimuth, azimuth, drive.mstate, drive.target_azimuth)
+        if commanded is not None:
+            drive.go(commanded)
+            moving = True
+
+    for i, now in enumerate(grid):
+        drive.advance(step)
+
+        while queue_index + 1 < len(queue_events) and queue_events[queue_index + 1][0] == i:
+            queue_index += 1
+            queued = queue_events[queue_index][1]
+
+        request = None
+        if segment_index + 1 < len(segments) and segments[segment_index + 1].start == i:
+            segment_index += 1
+            segment = request = segments[segment_index]
+
+        while exposure_index < len(exposures) and exposures[exposure_index].end <= now:
+            exposure_index += 1
+
+        exposure = None
+        if exposure_index < len(exposures) and exposures[exposure_index].registered <= now:
+            exposure = exposures[exposure_index]
+
+        if request is not None or now >= next_poll:
+            deferred_until = None
+            settling = False
+            update_state()
+            if request is not None:
+                if request.required is not None:
+                    wait_start = now
+                    wait_preslewed = preslew_active
+                    preslew_active = False
+
+                if request.call == 'notify_telescope_target_cleared':
+                    drive.stop()
+                    controller.cancel()
+                elif request.call == 'notify_telescope_parked':
+                    slew(config.park_azimuth)
+                elif request.required is not None:
+                    slew(request.dome_azimuth(now))
+                update_state()
+            elif not moving:
+                target = segment if segment is not None and segment.required is not None else None
+                queued = [t for t in queued if t.start > now]
+                next_target = (queued[0].start, queued[0].required) if queued else None
+                window = (exposure.start, exposure.end) if exposure is not None else None
+                action = controller.poll(now, dome_azimuth, drive.mstate, target, window, next_target)
+                reason = action.reason if action is not None else None
+                if reason == 'settle':
+                    settling = True
+                elif reason == 'nudge':
+                    drive.go(action.commanded)
+                    moving = True
+                elif reason == 'defer':
+                    deferred_until = action.deferred_until
+                elif reason is not None:
+                    if reason == 'preslew':
+                        preslew_active = True
+                    slew(action.azimuth)
+
+            delay = config.azimuth_moving_loop_delay if moving or settling else config.azimuth_loop_delay
+            next_poll = now + delay
+            if deferred_until is not None:
+                next_poll = min(next_poll, deferred_until)
+
+            if wait_start is not None and not moving and not settling:
+                waits[wait_preslewed].append(now - wait_start)
+                wait_start = None
+
+        vignetted = False
+        if segment is not None and segment.required is not None:
+            offset = i - segment.start
+            error = np.radians(abs(azimuth_delta(segment.required[offset] % 360, drive.azimuth)))
+            on_target_steps += 1
+            if config.dome_radius_cm * np.cos(np.radians(segment.alt[offset])) * np.sin(error) > clearance_cm:
+                vignetted_steps += 1
+                vignetted = True
+
+        if exposure_index < len(exposures) and exposures[exposure_index].start <= now and \
+                (vignetted or drive.moving):
+            ruined.add(exposure_index)
+
+    all_waits = waits[True] + waits[False]
+    return {
+        'on_target_seconds': on_target_steps * step,
+        'vignetted_fraction': vignetted_steps / on_target_steps if on_target_steps else 0,
+        'slews': controller.go_sent - controller.nudges,
+        'go_commands': drive.go_count,
+        'skipped_go_commands': controller.go_skipped,
+        'approach_nudges': controller.nudges,
+        'motor_seconds': drive.motor_seconds,
+        'targets': len(all_waits),
+        'mean_target_wait': float(np.mean(all_waits)) if all_waits else 0,
+        'preslewed_targets': len(waits[True]),
+        'mean_preslewed_wait': float(np.mean(waits[True])) if waits[True] else 0,
+        'exposures': sum(1 for e in exposures if e.start < grid[-1]),
+        'ruined_exposures': len(ruined)
+    }
+
+
+def parse_sweep(values):
+    """Parses repeated key=v1,v2,... arguments into a list of (key, [values])"""
+    sweep = []
+    for value in values:
+        key, _, options = value.partition('=')
+        if not options:
+            raise ValueError(f'invalid --set value `{value}` (expected key=value[,value...])')
+        sweep.append((key, [float(v) for v in options.split(',')]))
+    return sweep
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replays a pulsar_domed target log against a simulated dome')
+    parser.add_argument('config', help='Path to the daemon configuration json file')
+    parser.add_argument('log', help='Path to a target log written by pulsar_domed (target_log_path)')
+    parser.add_argument('--speed', default='4', help='Drive speed in deg/s (comma-separated values to sweep)')
+    parser.add_argument('--acceleration', default='1',
+                        help='Drive acceleration in deg/s^2 (comma-separated values to sweep)')
+    parser.add_argument('--approach-error', default='0,0',
+                        help='Signed stopping error of the drive in deg (positive for overshoots) '
+                             'for increasing,decreasing azimuth moves')
+    parser.add_argument('--creep-speed', type=float, default=0.2,
+                        help='Drive speed in deg/s over the last degree of each move')
+    parser.add_argument('--slit-width-cm', type=float, default=80, help='Width of the dome slit')
+    parser.add_argument('--aperture-cm', type=float, default=30, help='Diameter of the telescope beam at the slit')
+    parser.add_argument('--set', action='append', default=[], metavar='KEY=VALUE[,VALUE...]',
+                        help='Override (or sweep) a numeric config value, e.g. tracking_max_separation=1,2,3')
+    parser.add_argument('--step', type=float, default=1, help='Simulation time step in seconds')
+    parser.add_argument('--astrometry-step', type=float, default=10,
+                        help='Interval in seconds between astrometric evaluations of tracked targets')
+    parser.add_argument('--exposure-time', type=float,
+                        help='Generate back-to-back exposures of this many seconds on each tracked target')
+    parser.add_argument('--readout-time', type=float, default=10,
+                        help='Gap in seconds between generated exposures')
+    parser.add_argument('--acquisition-time', type=float, default=60,
+                        help='Delay in seconds from each target notification until the first generated exposure')
+    parser.add_argument('--tail', type=float, default=0, help='Seconds to continue simulating after the last call')
+    parser.add_argument('--json', action='store_true', help='Print the results as json')
+    args = parser.parse_args()
+
+    config = Config(args.config)
+    calls = load_log(args.log)
+    if not calls:
+        print('error: target log is empty')
+        return 1
+
+    approach_error = [float(v) for v in args.approach_error.split(',')]
+    if len(approach_error) != 2:
+        print('error: --approach-error must contain two values')
+        return 1
+
+    sweep = parse_sweep(args.set)
+    sweep.append(('speed', [float(v) for v in args.speed.split(',')]))
+    sweep.append(('acceleration', [float(v) for v in args.acceleration.split(',')]))
+    for key, _ in sweep:
+        if key not in ['speed', 'acceleration'] and not hasattr(config, key):
+            print(f'error: unknown config key `{key}`')
+            return 1
+
+    start = calls[0][0]
+    grid = np.arange(start, calls[-1][0] + args.tail + args.step, args.step)
+
+    queue_events = []
+    for c in calls:
+        if c[1] == 'queue_telescope_targets':
+            targets = [QueuedTarget(*t) for t in parse_queued_targets(c[2][0])]
+            queue_events.append((int(round((c[0] - start) / args.step)), targets))
+
+    # Exposures cleared by notify_exposure_cleared end at the time of the call
+    exposures = []
+    for c in calls:
+        if c[1] == 'notify_exposure':
+            exposures.append(Exposure(c[0], c[2][0], c[2][0] + c[2][1]))
+        elif c[1] == 'notify_exposure_cleared':
+            for exposure in exposures:
+                exposure.end = min(exposure.end, c[0])
+            exposures = [e for e in exposures if e.end > e.start]
+
+    calls = [c for c in calls if c[1] not in ['queue_telescope_targets', 'notify_exposure', 'notify_exposure_cleared']]
+    starts = [int(round((c[0] - start) / args.step)) for c in calls]
+    segments = [Segment(c[1], c[2], s, e) for c, s, e in zip(calls, starts, starts[1:] + [len(grid)])]
+
+    # Collapse notifications that land on the same simulation step; only the last one is acted on
+    segments = [s for s, n in zip(segments, segments[1:] + [None]) if n is None or n.start != s.start]
+
+    location = EarthLocation(lat=config.latitude * u.deg, lon=config.longitude * u.deg,
+                             height=config.altitude * u.m)
+    evaluate_astrometry(segments, grid, location, args.astrometry_step)
+    evaluate_queued_astrometry(queue_events, location)
+
+    if args.exposure_time is not None:
+        exposures += synthesize_exposures(segments, grid, args.exposure_time, args.readout_time, args.acquisition_time)
+    exposures.sort(key=lambda e: e.start)
+
+    clearance_cm = max(args.slit_width_cm - args.aperture_cm, 0) / 2
+    results = []
+    keys = [key for key, _ in sweep]
+    for values in itertools.product(*[v for _, v in sweep]):
+        params = dict(zip(keys, values))
+        run_config = copy.copy(config)
+        for key, value in params.items():
+            if hasattr(run_config, key):
+                setattr(run_config, key, value)
+
+        drive = SimulatedAzimuthDrive(run_config.park_azimuth, params['speed'], params['acceleration'],
+                                      approach_error, args.creep_speed)
+        result = replay(run_config, segments, queue_events, exposures, grid, drive, clearance_cm=clearance_cm)
+        results.append({'params': params, **result})
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+        return 0
+
+    print(f'Replayed {len(calls)} calls over {(grid[-1] - grid[0]) / 3600:.2f} hours')
+    for result in results:
+        params = ' '.join(f'{k}={v:g}' for k, v in result['params'].items())
+        print(f'{params}: vignetted {result["vignetted_fraction"] * 100:.2f}% of '
+              f'{result["on_target_seconds"] / 3600:.2f} h on target, {result["slews"]} slews, '
+              f'{result["go_commands"]} GO commands ({result["skipped_go_commands"]} skipped), '
+              f'{result["approach_nudges"]} nudges, {result["motor_seconds"]:.0f} s motor time, '
+              f'{result["mean_target_wait"]:.1f} s mean dome wait '
+              f'per target ({result["preslewed_targets"]}/{result["targets"]} pre-slewed)'
+              + (f', {result["ruined_exposures"]}/{result["exposures"]} exposures ruined'
+                 if result['exposures'] else ''))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())